@@ -1,105 +1,4234 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iterator>
 #include <glm/common.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define GLEW_STATIC 1
+
+// stb_image allocates its decode buffers from the image buffer pool below
+void *imagePoolAlloc(size_t size);
+void *imagePoolRealloc(void *block, size_t size);
+void imagePoolFree(void *block);
+#define STBI_MALLOC(size) imagePoolAlloc(size)
+#define STBI_REALLOC(block, size) imagePoolRealloc(block, size)
+#define STBI_FREE(block) imagePoolFree(block)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 using namespace glm;
 using namespace std;
 
-// === At top with includes ===
-GLuint createTexturedSphereVAO(unsigned int rings, unsigned int sectors, unsigned int &indexCount)
+// fixed set of worker threads pulling tasks from one queue
+class ThreadPool
 {
-    std::vector<vec3> vertices;
-    std::vector<vec2> uvs;
-    std::vector<unsigned int> indices;
+public:
+    explicit ThreadPool(unsigned int threadCount)
+    {
+        for (unsigned int i = 0; i < threadCount; ++i)
+        {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int size() const
+    {
+        return workers.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // runs body(begin, end) over [0, count) split into contiguous bands and waits for all of them
+    // a few bands per thread so one slow core does not hold up the rest; must not be called from a pool task
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)> &body)
+    {
+        size_t const bands = std::min(count, size_t(size()) * 4);
+        if (bands <= 1)
+        {
+            body(0, count);
+            return;
+        }
+
+        std::mutex doneMutex;
+        std::condition_variable done;
+        size_t remaining = bands;
+        for (size_t band = 0; band < bands; ++band)
+        {
+            size_t const begin = count * band / bands;
+            size_t const end = count * (band + 1) / bands;
+            submit([&, begin, end] {
+                body(begin, end);
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--remaining == 0)
+                {
+                    done.notify_one();
+                }
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&] { return remaining == 0; });
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// shared pool for CPU-heavy startup work, one thread per core
+ThreadPool &workerPool()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+// whole file mapped into memory, read-only or freshly created for writing
+// platforms without mmap get the same interface backed by a heap buffer
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    enum Access
+    {
+        RandomAccess,
+        SequentialAccess, // read front to back once, the kernel reads ahead and drops pages behind
+    };
+
+    bool openRead(const std::string &path, Access access = RandomAccess)
+    {
+        close();
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        if (access == SequentialAccess)
+        {
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            madvise(mapping, info.st_size, MADV_WILLNEED);
+        }
+        bytes = (unsigned char *)mapping;
+        length = info.st_size;
+#endif
+        return true;
+    }
+
+    // new file of exactly size bytes, contents reach the disk on close()
+    bool create(const std::string &path, size_t size)
+    {
+        close();
+#ifdef _WIN32
+        buffer.assign(size, 0);
+        writePath = path;
+        bytes = buffer.data();
+        length = size;
+#else
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (ftruncate(fd, size) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        bytes = (unsigned char *)mapping;
+        length = size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (!writePath.empty())
+        {
+            std::ofstream(writePath, std::ios::binary).write((const char *)buffer.data(), buffer.size());
+            writePath.clear();
+        }
+        buffer.clear();
+#else
+        if (bytes)
+        {
+            munmap(bytes, length);
+        }
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    unsigned char *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    unsigned char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::vector<unsigned char> buffer;
+    std::string writePath;
+#endif
+};
+
+// decode buffers for stb_image, recycled per thread in power-of-two size classes
+// a texture decode asks for the same few sizes every time (file-sized zlib and huffman buffers, the output image),
+// so after the first image the pool hands back blocks that are already faulted in instead of fresh pages from malloc
+// each block starts with a 16-byte header holding its class and capacity; large blocks bypass the pool
+// the caches only pay off within a batch of decodes, imagePoolTrim hands everything back once a batch is done
+const unsigned int imagePoolMinClass = 6;           // 64 bytes
+const unsigned int imagePoolMaxClass = 26;          // 64 MB
+const size_t imagePoolThreadBytes = size_t(96) << 20; // most a thread keeps cached
+const uint32_t imagePoolUnpooled = 0xffffffff;
+
+struct ImagePoolCache;
+std::mutex imagePoolRegistryMutex;
+std::set<ImagePoolCache *> imagePoolCaches; // every thread's cache, guarded by imagePoolRegistryMutex
+std::atomic<size_t> imagePoolBytes(0);      // cached over all threads
+
+struct ImagePoolHeader
+{
+    uint32_t sizeClass;
+    uint32_t reserved;
+    uint64_t capacity;
+};
+
+// the owning thread takes mutex around every list change, uncontended unless imagePoolTrim runs at the same time
+struct ImagePoolCache
+{
+    std::mutex mutex;
+    std::vector<void *> blocks[imagePoolMaxClass + 1];
+    size_t bytes = 0;
+
+    ImagePoolCache()
+    {
+        std::lock_guard<std::mutex> lock(imagePoolRegistryMutex);
+        imagePoolCaches.insert(this);
+    }
+
+    ~ImagePoolCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(imagePoolRegistryMutex);
+            imagePoolCaches.erase(this);
+        }
+        trim();
+    }
+
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::vector<void *> &list : blocks)
+        {
+            for (void *block : list)
+            {
+                free(block);
+            }
+            list.clear();
+        }
+        imagePoolBytes -= bytes;
+        bytes = 0;
+    }
+};
+
+std::atomic<bool> imagePoolEnabled(true);
+std::atomic<unsigned long long> imagePoolHits(0);
+std::atomic<unsigned long long> imagePoolMisses(0);
+thread_local ImagePoolCache imagePoolCache;
+
+void *imagePoolAlloc(size_t size)
+{
+    size_t const total = size + sizeof(ImagePoolHeader);
+    uint32_t sizeClass = imagePoolMinClass;
+    while (sizeClass <= imagePoolMaxClass && (size_t(1) << sizeClass) < total)
+    {
+        sizeClass++;
+    }
+
+    ImagePoolHeader *header = nullptr;
+    if (sizeClass > imagePoolMaxClass || !imagePoolEnabled)
+    {
+        header = (ImagePoolHeader *)malloc(total);
+        if (!header)
+        {
+            return nullptr;
+        }
+        header->sizeClass = imagePoolUnpooled;
+        header->capacity = size;
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(imagePoolCache.mutex);
+            std::vector<void *> &list = imagePoolCache.blocks[sizeClass];
+            if (!list.empty())
+            {
+                header = (ImagePoolHeader *)list.back();
+                list.pop_back();
+                imagePoolCache.bytes -= size_t(1) << sizeClass;
+                imagePoolBytes -= size_t(1) << sizeClass;
+                imagePoolHits++;
+            }
+        }
+        if (!header)
+        {
+            header = (ImagePoolHeader *)malloc(size_t(1) << sizeClass);
+            if (!header)
+            {
+                return nullptr;
+            }
+            imagePoolMisses++;
+        }
+        header->sizeClass = sizeClass;
+        header->capacity = (size_t(1) << sizeClass) - sizeof(ImagePoolHeader);
+    }
+    return header + 1;
+}
+
+void imagePoolFree(void *block)
+{
+    if (!block)
+    {
+        return;
+    }
+    ImagePoolHeader *header = (ImagePoolHeader *)block - 1;
+    if (header->sizeClass != imagePoolUnpooled && imagePoolEnabled)
+    {
+        std::lock_guard<std::mutex> lock(imagePoolCache.mutex);
+        size_t const blockBytes = size_t(1) << header->sizeClass;
+        if (imagePoolCache.bytes + blockBytes <= imagePoolThreadBytes)
+        {
+            imagePoolCache.blocks[header->sizeClass].push_back(header);
+            imagePoolCache.bytes += blockBytes;
+            imagePoolBytes += blockBytes;
+            return;
+        }
+    }
+    free(header);
+}
+
+// frees the blocks cached by every thread, safe to call from any thread while others decode
+void imagePoolTrim()
+{
+    std::lock_guard<std::mutex> lock(imagePoolRegistryMutex);
+    for (ImagePoolCache *cache : imagePoolCaches)
+    {
+        cache->trim();
+    }
+}
+
+void *imagePoolRealloc(void *block, size_t size)
+{
+    if (!block)
+    {
+        return imagePoolAlloc(size);
+    }
+    ImagePoolHeader *header = (ImagePoolHeader *)block - 1;
+    if (size <= header->capacity)
+    {
+        return block;
+    }
+    void *grown = imagePoolAlloc(size);
+    if (grown)
+    {
+        memcpy(grown, block, header->capacity);
+        imagePoolFree(block);
+    }
+    return grown;
+}
+
+// decodes an image to channels per pixel from a read-only mapping of the file instead of stdio reads
+// free the result with stbi_image_free; nullptr when the file is missing or not an image
+unsigned char *loadImage(const std::string &path, int *width, int *height, int channels)
+{
+    MappedFile file;
+    if (!file.openRead(path, MappedFile::SequentialAccess))
+    {
+        return nullptr;
+    }
+    return stbi_load_from_memory(file.data(), int(file.size()), width, height, nullptr, channels);
+}
+
+// one attribute of an interleaved vertex, as glVertexAttribPointer wants it
+struct VertexAttribute
+{
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+struct VertexFormat
+{
+    GLsizei stride;
+    std::vector<VertexAttribute> attributes;
+};
+
+// attribute pointers for the bound VAO/VBO, generated from the format description
+void applyVertexFormat(const VertexFormat &format)
+{
+    for (const VertexAttribute &attribute : format.attributes)
+    {
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized, format.stride,
+                              (void *)attribute.offset);
+        glEnableVertexAttribArray(attribute.location);
+    }
+}
+
+// fixed point helpers for the quantized layouts
+// snorm follows the GL 4.2+ rule (c / 32767), which represents 0 and +-1 exactly
+short packSnorm16(float v)
+{
+    return (short)std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+unsigned short packUnorm16(float v)
+{
+    return (unsigned short)std::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
+float unpackSnorm16(short v)
+{
+    return std::max(v / 32767.0f, -1.0f);
+}
+
+float unpackUnorm16(unsigned short v)
+{
+    return v / 65535.0f;
+}
+
+// vertex layouts the sphere generator can emit
+// each layout knows how to build itself from a point on the unit sphere and how to describe itself to GL
+struct PositionUV
+{
+    vec3 position;
+    vec2 uv;
+
+    static const char *layoutName()
+    {
+        return "PositionUV";
+    }
+
+    static PositionUV fromSphere(const vec3 &position, const vec2 &uv)
+    {
+        return {position, uv};
+    }
+
+    static VertexFormat format()
+    {
+        return {sizeof(PositionUV),
+                {{0, 3, GL_FLOAT, GL_FALSE, offsetof(PositionUV, position)}, // aPos
+                 {1, 2, GL_FLOAT, GL_FALSE, offsetof(PositionUV, uv)}}};     // aTexCoord
+    }
+};
+
+struct PositionColor
+{
+    vec3 position;
+    vec3 color;
+
+    static const char *layoutName()
+    {
+        return "PositionColor";
+    }
+
+    static PositionColor fromSphere(const vec3 &position, const vec2 &)
+    {
+        return {position, vec3(1.0f, 0.0f, 1.0f)}; // pink color!
+    }
+
+    static VertexFormat format()
+    {
+        return {sizeof(PositionColor),
+                {{0, 3, GL_FLOAT, GL_FALSE, offsetof(PositionColor, position)}, // aPos
+                 {1, 3, GL_FLOAT, GL_FALSE, offsetof(PositionColor, color)}}};  // aColor
+    }
+};
+
+struct PositionNormalUV
+{
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+
+    static const char *layoutName()
+    {
+        return "PositionNormalUV";
+    }
+
+    static PositionNormalUV fromSphere(const vec3 &position, const vec2 &uv)
+    {
+        return {position, position, uv}; // unit sphere: the normal is the position
+    }
+
+    static VertexFormat format()
+    {
+        return {sizeof(PositionNormalUV),
+                {{0, 3, GL_FLOAT, GL_FALSE, offsetof(PositionNormalUV, position)}, // aPos
+                 {1, 2, GL_FLOAT, GL_FALSE, offsetof(PositionNormalUV, uv)},       // aTexCoord
+                 {2, 3, GL_FLOAT, GL_FALSE, offsetof(PositionNormalUV, normal)}}}; // aNormal
+    }
+};
+
+// quantized PositionUV: snorm16 position, unorm16 uv
+// 12 bytes per vertex instead of 20, positions must lie in [-1, 1] (true for the unit sphere)
+// no normal: the sphere shaders are unlit, and on the unit sphere the normal is the position anyway
+struct PackedPositionUV
+{
+    short position[4]; // w is padding, keeps the uv 4-byte aligned
+    unsigned short uv[2];
+
+    static const char *layoutName()
+    {
+        return "PackedPositionUV";
+    }
+
+    static PackedPositionUV fromSphere(const vec3 &position, const vec2 &uv)
+    {
+        return {{packSnorm16(position.x), packSnorm16(position.y), packSnorm16(position.z), 0},
+                {packUnorm16(uv.x), packUnorm16(uv.y)}};
+    }
+
+    vec3 decodePosition() const
+    {
+        return vec3(unpackSnorm16(position[0]), unpackSnorm16(position[1]), unpackSnorm16(position[2]));
+    }
+
+    vec2 decodeUV() const
+    {
+        return vec2(unpackUnorm16(uv[0]), unpackUnorm16(uv[1]));
+    }
+
+    static VertexFormat format()
+    {
+        return {sizeof(PackedPositionUV),
+                {{0, 3, GL_SHORT, GL_TRUE, offsetof(PackedPositionUV, position)},     // aPos
+                 {1, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedPositionUV, uv)}}}; // aTexCoord
+    }
+};
+
+// quantized PositionColor for the cube: snorm16 position, unorm8 color, 12 bytes instead of 24
+struct PackedPositionColor
+{
+    short position[4];
+    unsigned char color[4];
+
+    static PackedPositionColor pack(const vec3 &position, const vec3 &color)
+    {
+        return {{packSnorm16(position.x), packSnorm16(position.y), packSnorm16(position.z), 0},
+                {(unsigned char)std::round(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f),
+                 (unsigned char)std::round(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f),
+                 (unsigned char)std::round(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f), 255}};
+    }
+
+    vec3 decodePosition() const
+    {
+        return vec3(unpackSnorm16(position[0]), unpackSnorm16(position[1]), unpackSnorm16(position[2]));
+    }
+
+    static VertexFormat format()
+    {
+        return {sizeof(PackedPositionColor),
+                {{0, 3, GL_SHORT, GL_TRUE, offsetof(PackedPositionColor, position)},         // aPos
+                 {1, 3, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PackedPositionColor, color)}}};  // aColor
+    }
+};
+
+// marks the end of a strip in 32-bit source indices, narrowed with the index type on upload
+const unsigned int primitiveRestartIndex = 0xFFFFFFFF;
+
+// sin/cos tables of a UV sphere grid, they only depend on the ring or on the sector
+// so they are evaluated once instead of per vertex
+struct SphereTables
+{
+    unsigned int rings, sectors;
+    float R, S;
+    std::vector<float> ringY, ringRadius;
+    std::vector<float> sectorCos, sectorSin;
+
+    SphereTables(unsigned int rings, unsigned int sectors)
+        : rings(rings), sectors(sectors), R(1.0f / float(rings - 1)), S(1.0f / float(sectors - 1)), ringY(rings),
+          ringRadius(rings), sectorCos(sectors), sectorSin(sectors)
+    {
+        for (unsigned int r = 0; r < rings; ++r)
+        {
+            ringY[r] = sin(-glm::half_pi<float>() + glm::pi<float>() * r * R);
+            ringRadius[r] = sin(glm::pi<float>() * r * R);
+        }
+        for (unsigned int s = 0; s < sectors; ++s)
+        {
+            sectorCos[s] = cos(2 * glm::pi<float>() * s * S);
+            sectorSin[s] = sin(2 * glm::pi<float>() * s * S);
+        }
+    }
+};
+
+size_t sphereIndexCount(unsigned int rings, unsigned int sectors, GLenum mode)
+{
+    if (mode == GL_TRIANGLE_STRIP)
+    {
+        return size_t(rings - 1) * sectors * 2 + (rings - 2);
+    }
+    return size_t(rings - 1) * (sectors - 1) * 6;
+}
+
+// the writers below fill rows [rowBegin, rowEnd) in place inside buffers sized for the whole sphere,
+// so bands of rows can be produced independently and in any order
+
+// vertex rows, rings in total
+template <typename Vertex>
+void writeSphereVertices(const SphereTables &tables, unsigned int rowBegin, unsigned int rowEnd, Vertex *vertices)
+{
+    Vertex *vertex = vertices + size_t(rowBegin) * tables.sectors;
+    for (unsigned int r = rowBegin; r < rowEnd; ++r)
+    {
+        for (unsigned int s = 0; s < tables.sectors; ++s)
+        {
+            vec3 const position(tables.sectorCos[s] * tables.ringRadius[r], tables.ringY[r], tables.sectorSin[s] * tables.ringRadius[r]);
+            *vertex++ = Vertex::fromSphere(position, vec2(s * tables.S, r * tables.R));
+        }
+    }
+}
+
+// triangle list quad rows, rings - 1 in total
+void writeSphereIndices(unsigned int sectors, unsigned int rowBegin, unsigned int rowEnd, unsigned int *indices)
+{
+    unsigned int *index = indices + size_t(rowBegin) * (sectors - 1) * 6;
+    for (unsigned int r = rowBegin; r < rowEnd; ++r)
+    {
+        for (unsigned int s = 0; s < sectors - 1; ++s)
+        {
+            *index++ = r * sectors + s;
+            *index++ = r * sectors + (s + 1);
+            *index++ = (r + 1) * sectors + (s + 1);
+
+            *index++ = r * sectors + s;
+            *index++ = (r + 1) * sectors + (s + 1);
+            *index++ = (r + 1) * sectors + s;
+        }
+    }
+}
+
+// one triangle strip per ring band, separated by restart markers, rings - 1 bands in total
+// two indices per quad instead of six, with the same winding as the triangle list
+void writeSphereStripIndices(unsigned int sectors, unsigned int rowBegin, unsigned int rowEnd, unsigned int *indices)
+{
+    for (unsigned int r = rowBegin; r < rowEnd; ++r)
+    {
+        unsigned int *index = indices + size_t(r) * (sectors * 2 + 1);
+        if (r > 0)
+        {
+            index[-1] = primitiveRestartIndex;
+        }
+        for (unsigned int s = 0; s < sectors; ++s)
+        {
+            *index++ = (r + 1) * sectors + s;
+            *index++ = r * sectors + s;
+        }
+    }
+}
+
+// UV sphere with rings x sectors vertices, written into pre-sized storage
+template <typename Vertex>
+void generateSphere(unsigned int rings, unsigned int sectors, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    SphereTables const tables(rings, sectors);
+    vertices.resize(size_t(rings) * sectors);
+    writeSphereVertices(tables, 0, rings, vertices.data());
+
+    indices.resize(sphereIndexCount(rings, sectors, GL_TRIANGLES));
+    writeSphereIndices(sectors, 0, rings - 1, indices.data());
+}
+
+// the same sphere grid as generateSphere as strips with primitive restart
+void generateSphereStripIndices(unsigned int rings, unsigned int sectors, std::vector<unsigned int> &indices)
+{
+    indices.resize(sphereIndexCount(rings, sectors, GL_TRIANGLE_STRIP));
+    writeSphereStripIndices(sectors, 0, rings - 1, indices.data());
+}
+
+// generateSphere split into row bands on the pool, written straight into caller-provided storage
+// (pre-sized arrays or mapped GPU buffers) with no intermediate vectors
+template <typename Vertex>
+void generateSphereParallel(unsigned int rings, unsigned int sectors, GLenum mode, Vertex *vertices, unsigned int *indices,
+                            ThreadPool &pool)
+{
+    SphereTables const tables(rings, sectors);
+    pool.parallelFor(rings, [&](size_t begin, size_t end) {
+        writeSphereVertices(tables, begin, end, vertices);
+
+        // quad row r joins vertex rows r and r + 1, there is one fewer of them
+        size_t const quadEnd = std::min(end, size_t(rings - 1));
+        if (begin < quadEnd)
+        {
+            if (mode == GL_TRIANGLE_STRIP)
+            {
+                writeSphereStripIndices(sectors, begin, quadEnd, indices);
+            }
+            else
+            {
+                writeSphereIndices(sectors, begin, quadEnd, indices);
+            }
+        }
+    });
+}
+
+// generateSphereParallel at close-up tessellation on 1, 2, 4, ... threads
+// buffers are allocated and touched once up front so page faults are not part of the timing
+void benchmarkParallelSphereGeneration()
+{
+    unsigned int const rings = 4096, sectors = 4096;
+    std::vector<PositionUV> vertices(size_t(rings) * sectors);
+    std::vector<unsigned int> indices(sphereIndexCount(rings, sectors, GL_TRIANGLES));
+
+    unsigned int const maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double singleThreadSeconds = 0.0;
+    for (unsigned int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            generateSphereParallel(rings, sectors, GL_TRIANGLES, vertices.data(), indices.data(), pool);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (threads == 1)
+        {
+            singleThreadSeconds = best;
+        }
+
+        double const speedup = singleThreadSeconds / best;
+        std::cout << "sphere " << rings << "x" << sectors << " on " << threads << " threads: " << best * 1000.0 << " ms, "
+                  << vertices.size() / best / 1e6 << " Mvertices/s, speedup " << speedup << ", efficiency "
+                  << speedup / threads * 100.0 << "%" << std::endl;
+    }
+}
+
+// icosahedron subdivided `subdivisions` times with every new vertex pushed back onto the unit sphere
+// triangles are spread evenly instead of crowding the poles like the UV sphere does
+// UVs use generateSphere's mapping; triangles straddling the u = 0/1 seam get duplicated vertices with u + 1,
+// and each triangle touching a pole gets its own pole vertex with the u of its other two corners
+template <typename Vertex>
+void generateIcosphere(unsigned int subdivisions, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    float const t = (1.0f + sqrt(5.0f)) * 0.5f;
+    std::vector<vec3> positions = {vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0),
+                                   vec3(0, -1, t), vec3(0, 1, t), vec3(0, -1, -t), vec3(0, 1, -t),
+                                   vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)};
+    for (vec3 &p : positions)
+    {
+        p = normalize(p);
+    }
+    indices = {0, 11, 5, 0, 5, 1,  0, 1, 7,   0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4,  11, 10, 2,  10, 7, 6, 7, 1, 8,
+               3, 9, 4, 3, 4, 2,  3, 2, 6,   3, 6, 8,  3, 8, 9,   4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7,   9, 8, 1};
+
+    // split every edge once per level, midpoints shared between the two triangles of an edge
+    for (unsigned int level = 0; level < subdivisions; ++level)
+    {
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            std::pair<unsigned int, unsigned int> const edge(std::min(a, b), std::max(a, b));
+            auto found = midpoints.find(edge);
+            if (found != midpoints.end())
+            {
+                return found->second;
+            }
+            positions.push_back(normalize(positions[a] + positions[b]));
+            unsigned int const index = positions.size() - 1;
+            midpoints[edge] = index;
+            return index;
+        };
+
+        std::vector<unsigned int> next;
+        next.reserve(indices.size() * 4);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int const a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            unsigned int const ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            unsigned int const split[] = {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca};
+            next.insert(next.end(), split, split + 12);
+        }
+        indices.swap(next);
+    }
+
+    // same winding as generateSphere, so culling treats both meshes alike
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        vec3 const &a = positions[indices[i]], &b = positions[indices[i + 1]], &c = positions[indices[i + 2]];
+        if (dot(cross(b - a, c - a), a + b + c) > 0.0f)
+        {
+            std::swap(indices[i + 1], indices[i + 2]);
+        }
+    }
+
+    std::vector<vec2> uvs(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        float u = atan2(positions[i].z, positions[i].x) / glm::two_pi<float>();
+        uvs[i] = vec2(u < 0.0f ? u + 1.0f : u, acos(glm::clamp(-positions[i].y, -1.0f, 1.0f)) / glm::pi<float>());
+    }
+
+    std::map<unsigned int, unsigned int> seamCopies;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        unsigned int *triangle = &indices[i];
+
+        float const minU = std::min(uvs[triangle[0]].x, std::min(uvs[triangle[1]].x, uvs[triangle[2]].x));
+        float const maxU = std::max(uvs[triangle[0]].x, std::max(uvs[triangle[1]].x, uvs[triangle[2]].x));
+        if (maxU - minU > 0.5f)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                if (uvs[triangle[k]].x < 0.5f)
+                {
+                    auto copy = seamCopies.find(triangle[k]);
+                    if (copy == seamCopies.end())
+                    {
+                        positions.push_back(positions[triangle[k]]);
+                        uvs.push_back(uvs[triangle[k]] + vec2(1.0f, 0.0f));
+                        copy = seamCopies.insert(std::make_pair(triangle[k], unsigned(positions.size() - 1))).first;
+                    }
+                    triangle[k] = copy->second;
+                }
+            }
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (fabs(positions[triangle[k]].y) > 0.9999f)
+            {
+                float const u = (uvs[triangle[(k + 1) % 3]].x + uvs[triangle[(k + 2) % 3]].x) * 0.5f;
+                positions.push_back(positions[triangle[k]]);
+                uvs.push_back(vec2(u, uvs[triangle[k]].y));
+                triangle[k] = positions.size() - 1;
+            }
+        }
+    }
+
+    vertices.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        vertices[i] = Vertex::fromSphere(positions[i], uvs[i]);
+    }
+}
+
+// position of a sphere vertex as the GPU sees it, whatever the layout
+template <typename Vertex>
+vec3 spherePosition(const Vertex &vertex)
+{
+    return vertex.position;
+}
+
+vec3 spherePosition(const PackedPositionUV &vertex)
+{
+    return vertex.decodePosition();
+}
+
+// largest distance between the unit sphere and the mesh silhouette, i.e. the worst edge sag 1 - |midpoint|
+// the silhouette of a convex mesh is made of its edges, so this bounds how far the outline is off the true circle
+template <typename Vertex>
+float sphereSilhouetteError(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            vec3 const mid = (spherePosition(vertices[indices[i + k]]) + spherePosition(vertices[indices[i + (k + 1) % 3]])) * 0.5f;
+            error = std::max(error, 1.0f - length(mid));
+        }
+    }
+    return error;
+}
+
+// sphereSilhouetteError of a UV sphere without building it: every sector column is a rotated copy of the first,
+// so the edges of one column of quads (side, meridian and diagonal) are enough
+float uvSphereSilhouetteError(unsigned int rings, unsigned int sectors)
+{
+    SphereTables const tables(rings, sectors);
+    auto position = [&](unsigned int r, unsigned int s) {
+        return vec3(tables.sectorCos[s] * tables.ringRadius[r], tables.ringY[r], tables.sectorSin[s] * tables.ringRadius[r]);
+    };
+
+    float error = 0.0f;
+    for (unsigned int r = 0; r < rings; ++r)
+    {
+        error = std::max(error, 1.0f - length((position(r, 0) + position(r, 1)) * 0.5f));
+        if (r + 1 < rings)
+        {
+            error = std::max(error, 1.0f - length((position(r, 0) + position(r + 1, 0)) * 0.5f));
+            error = std::max(error, 1.0f - length((position(r, 0) + position(r + 1, 1)) * 0.5f));
+        }
+    }
+    return error;
+}
+
+// coarsest icosphere whose silhouette is at least as close to the sphere as a rings x sectors UV sphere
+unsigned int icosphereLevelForUVSphere(unsigned int rings, unsigned int sectors)
+{
+    float const target = uvSphereSilhouetteError(rings, sectors);
+
+    std::vector<PositionUV> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int level = 0;
+    for (; level < 8; ++level)
+    {
+        generateIcosphere(level, vertices, indices);
+        if (sphereSilhouetteError(vertices, indices) <= target)
+        {
+            break;
+        }
+    }
+    return level;
+}
+
+// triangle count and silhouette error of the 40x40 UV sphere against every icosphere level
+void reportIcosphere()
+{
+    std::vector<PositionUV> vertices;
+    std::vector<unsigned int> indices;
+    generateSphere(40, 40, vertices, indices);
+    std::cout << "uvsphere 40x40: " << indices.size() / 3 << " triangles, " << vertices.size()
+              << " vertices, silhouette error " << sphereSilhouetteError(vertices, indices) << std::endl;
+
+    unsigned int const matched = icosphereLevelForUVSphere(40, 40);
+    for (unsigned int level = 0; level <= 5; ++level)
+    {
+        generateIcosphere(level, vertices, indices);
+        std::cout << "icosphere level " << level << ": " << indices.size() / 3 << " triangles, " << vertices.size()
+                  << " vertices, silhouette error " << sphereSilhouetteError(vertices, indices)
+                  << (level == matched ? "  <- matches 40x40" : "") << std::endl;
+    }
+}
+
+// post-transform vertex cache behaviour of an index buffer, simulated as a FIFO of cacheSize entries
+// ACMR: transformed vertices per triangle (0.5 is ideal for large grids, 3 is no reuse at all)
+// ATVR: transformed vertices per unique vertex (1.0 is ideal)
+struct VertexCacheStats
+{
+    double acmr;
+    double atvr;
+};
+
+// number of vertex shader invocations for an index stream, restart markers are skipped
+size_t simulateVertexCache(const std::vector<unsigned int> &indices, unsigned int cacheSize)
+{
+    std::vector<unsigned int> cache(cacheSize, primitiveRestartIndex);
+    size_t head = 0, misses = 0;
+
+    for (unsigned int index : indices)
+    {
+        if (index == primitiveRestartIndex)
+        {
+            continue;
+        }
+        if (std::find(cache.begin(), cache.end(), index) == cache.end())
+        {
+            cache[head] = index;
+            head = (head + 1) % cacheSize;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t const misses = simulateVertexCache(indices, cacheSize);
+
+    std::vector<char> used(vertexCount, 0);
+    size_t uniqueVertices = 0;
+    for (unsigned int index : indices)
+    {
+        if (!used[index])
+        {
+            used[index] = 1;
+            uniqueVertices++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = indices.empty() ? 0.0 : double(misses) / double(indices.size() / 3);
+    stats.atvr = uniqueVertices == 0 ? 0.0 : double(misses) / double(uniqueVertices);
+    return stats;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation
+// greedily emits the triangle whose vertices score best against a simulated LRU cache,
+// favouring recently used vertices and vertices with few triangles left
+namespace forsyth
+{
+const int cacheSize = 32;
+const float cacheDecayPower = 1.5f;
+const float lastTriangleScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, unsigned int activeTriangles)
+{
+    if (activeTriangles == 0)
+    {
+        return -1.0f; // nothing left to draw with this vertex
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // used by the last triangle, fixed score so it is not favoured over the rest of the cache
+            score = lastTriangleScore;
+        }
+        else
+        {
+            float const scaler = 1.0f / (cacheSize - 3);
+            score = pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+        }
+    }
+    return score + valenceBoostScale * pow(float(activeTriangles), -valenceBoostPower);
+}
+} // namespace forsyth
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    size_t const triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // vertex -> triangle adjacency, packed into one array
+    std::vector<unsigned int> activeTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+    {
+        activeTriangles[index]++;
+    }
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + activeTriangles[v];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScore[v] = forsyth::vertexScore(-1, activeTriangles[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    // LRU cache, three slots of slack for the vertices of the triangle being added
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(forsyth::cacheSize + 3);
+    nextCache.reserve(forsyth::cacheSize + 3);
+
+    size_t scanCursor = 0;
+    long bestTriangle = -1;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        if (bestTriangle < 0)
+        {
+            // nothing in the cache is adjacent to a pending triangle, start a new strip of work
+            while (emitted[scanCursor])
+            {
+                scanCursor++;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        unsigned int const *triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = 1;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // retire this triangle from its vertices' adjacency lists
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int const v = triangle[k];
+            unsigned int *begin = &adjacency[adjacencyOffset[v]];
+            unsigned int *end = begin + activeTriangles[v];
+            *std::find(begin, end, (unsigned int)bestTriangle) = *(end - 1);
+            activeTriangles[v]--;
+        }
+
+        // move the triangle's vertices to the front of the cache
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+            {
+                nextCache.push_back(v);
+            }
+        }
+        cache.swap(nextCache);
+
+        // rescore everything that was or is in the cache
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            unsigned int const v = cache[i];
+            int const position = i < size_t(forsyth::cacheSize) ? int(i) : -1;
+
+            float const newScore = forsyth::vertexScore(position, activeTriangles[v]);
+            float const delta = newScore - vertexScore[v];
+            vertexScore[v] = newScore;
+
+            for (unsigned int a = 0; a < activeTriangles[v]; ++a)
+            {
+                triangleScore[adjacency[adjacencyOffset[v] + a]] += delta;
+            }
+        }
+        if (cache.size() > size_t(forsyth::cacheSize))
+        {
+            cache.resize(forsyth::cacheSize);
+        }
+
+        // only once every score is final, the next best triangle among the neighbours of what stayed cached
+        float bestScore = -1.0f;
+        bestTriangle = -1;
+        for (unsigned int v : cache)
+        {
+            for (unsigned int a = 0; a < activeTriangles[v]; ++a)
+            {
+                unsigned int const t = adjacency[adjacencyOffset[v] + a];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+// ACMR/ATVR of a mesh before and after optimizeVertexCache, for typical FIFO cache sizes
+void reportVertexCache(const std::string &name, const std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    std::vector<unsigned int> optimized = indices;
+    auto start = std::chrono::steady_clock::now();
+    optimizeVertexCache(optimized, vertexCount);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << indices.size() / 3 << " triangles, " << vertexCount << " vertices, optimized in " << ms
+              << " ms" << std::endl;
+    for (unsigned int cacheSize : {12u, 16u, 32u})
+    {
+        VertexCacheStats before = analyzeVertexCache(indices, vertexCount, cacheSize);
+        VertexCacheStats after = analyzeVertexCache(optimized, vertexCount, cacheSize);
+        std::cout << "  fifo " << cacheSize << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+                  << " -> " << after.atvr << std::endl;
+    }
+}
+
+void reportSphereVertexCache()
+{
+    for (unsigned int tessellation : {40u, 128u, 512u})
+    {
+        std::vector<PositionUV> vertices;
+        std::vector<unsigned int> indices;
+        generateSphere(tessellation, tessellation, vertices, indices);
+        reportVertexCache("uvsphere " + std::to_string(tessellation) + "x" + std::to_string(tessellation), indices,
+                          vertices.size());
+    }
+}
+
+// bytes the vertex stage pulls per frame for the three 40x40 bodies (and a close-up sphere) under each index encoding
+// index bytes are exact, vertex bytes are estimated from a 32-entry FIFO post-transform cache
+void benchmarkIndexEncodings()
+{
+    unsigned int const cacheSize = 32;
+    for (unsigned int tessellation : {40u, 128u, 512u})
+    {
+        unsigned int const bodies = tessellation == 40 ? 3 : 1;
+        std::vector<PositionUV> vertices;
+        std::vector<unsigned int> list, strip;
+        generateSphere(tessellation, tessellation, vertices, list);
+        generateSphereStripIndices(tessellation, tessellation, strip);
+        std::vector<unsigned int> optimizedList = list;
+        optimizeVertexCache(optimizedList, vertices.size());
+
+        size_t const narrowIndexSize = vertices.size() <= 0xFFFF ? 2 : 4;
+        struct Encoding
+        {
+            const char *name;
+            const std::vector<unsigned int> *indices;
+            size_t indexSize;
+        };
+        Encoding const encodings[] = {{"u32 list, row order", &list, 4},
+                                      {"u32 list, cache optimized", &optimizedList, 4},
+                                      {"narrow list, cache optimized", &optimizedList, narrowIndexSize},
+                                      {"narrow strip + restart", &strip, narrowIndexSize}};
+
+        std::cout << bodies << " x uvsphere " << tessellation << "x" << tessellation << " (" << vertices.size()
+                  << " vertices, " << narrowIndexSize * 8 << "-bit narrow indices)" << std::endl;
+        for (const Encoding &e : encodings)
+        {
+            size_t const indexBytes = e.indices->size() * e.indexSize * bodies;
+            size_t const vertexBytes = simulateVertexCache(*e.indices, cacheSize) * sizeof(PositionUV) * bodies;
+            std::cout << "  " << e.name << ": " << indexBytes / 1024.0 << " KB indices + " << vertexBytes / 1024.0
+                      << " KB vertices = " << (indexBytes + vertexBytes) / 1024.0 << " KB/frame" << std::endl;
+        }
+    }
+}
+
+// visual diff of the quantized layouts against the float path
+// each mesh is projected with the scene projection at 800x600, close enough to fill the screen (worst case for
+// position error), and compared in pixels and in texels of a 16k x 8k map
+bool verifyQuantizedFormats()
+{
+    float const maxPixelError = 0.25f;
+    float const maxTexelError = 0.25f;
+    vec2 const viewport(800.0f, 600.0f);
+    vec2 const textureSize(16384.0f, 8192.0f);
+
+    // same projection as the scene, the unit sphere at this distance spans the viewport height
+    mat4 const projection = glm::perspective(70.0f, 800.0f / 600.0f, 0.01f, 100.0f);
+    mat4 const mvp = projection * translate(mat4(1.0f), vec3(0.0f, 0.0f, -projection[1][1]));
+    auto toScreen = [&](const vec3 &p) {
+        vec4 const clip = mvp * vec4(p, 1.0f);
+        return (vec2(clip.x, clip.y) / clip.w * 0.5f + vec2(0.5f)) * viewport;
+    };
+
+    bool passed = true;
+    for (unsigned int tessellation : {40u, 512u})
+    {
+        std::vector<PositionUV> reference;
+        std::vector<PackedPositionUV> packed;
+        std::vector<unsigned int> indices;
+        generateSphere(tessellation, tessellation, reference, indices);
+        generateSphere(tessellation, tessellation, packed, indices);
+
+        float pixelError = 0.0f, texelError = 0.0f;
+        for (size_t i = 0; i < reference.size(); ++i)
+        {
+            pixelError = std::max(pixelError, length(toScreen(reference[i].position) - toScreen(packed[i].decodePosition())));
+            texelError = std::max(texelError, length((reference[i].uv - packed[i].decodeUV()) * textureSize));
+        }
+
+        bool const ok = pixelError <= maxPixelError && texelError <= maxTexelError;
+        passed = passed && ok;
+        std::cout << "uvsphere " << tessellation << "x" << tessellation << ": " << sizeof(PositionUV) << " -> "
+                  << sizeof(PackedPositionUV) << " bytes/vertex, max error " << pixelError << " px, " << texelError
+                  << " texels " << (ok ? "OK" : "FAILED") << std::endl;
+    }
+
+    // the cube only uses +-0.5 corners
+    float pixelError = 0.0f;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        vec3 const p((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f);
+        pixelError = std::max(pixelError, length(toScreen(p) - toScreen(PackedPositionColor::pack(p, vec3(1.0f)).decodePosition())));
+    }
+    bool const ok = pixelError <= maxPixelError;
+    passed = passed && ok;
+    std::cout << "cube: " << sizeof(PositionColor) << " -> " << sizeof(PackedPositionColor) << " bytes/vertex, max error "
+              << pixelError << " px " << (ok ? "OK" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+// GPU side of an uploaded mesh, owns its GL objects
+struct Mesh
+{
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    unsigned int indexCount = 0;
+    unsigned int triangleCount = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLuint restartIndex = 0; // only used by strips
+    size_t uploadedBytes = 0;
+    float silhouetteError = 0.0f; // registry spheres only, see sphereSilhouetteError
+
+    Mesh() = default;
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    ~Mesh()
+    {
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteVertexArrays(1, &vao);
+    }
+};
+
+typedef std::shared_ptr<Mesh> MeshHandle;
+
+// everything glBufferData needs for one mesh, pointing at freshly generated arrays or into a mapped cache file
+struct MeshBlob
+{
+    const void *vertices;
+    size_t vertexBytes;
+    const void *indices;
+    size_t indexCount;
+    GLenum indexType;
+    GLuint restartIndex;
+    GLenum mode;
+    unsigned int triangleCount;
+    float silhouetteError;
+
+    size_t indexBytes() const
+    {
+        return indexCount * (indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+    }
+};
+
+// GPU-ready form of a generated mesh, indices narrowed into narrowIndices when every vertex fits in 16 bits
+// 8-bit indices are skipped on purpose, most GPUs widen them in the driver
+template <typename Vertex>
+MeshBlob packMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, GLenum mode,
+                  std::vector<unsigned short> &narrowIndices)
+{
+    MeshBlob blob;
+    blob.vertices = vertices.data();
+    blob.vertexBytes = vertices.size() * sizeof(Vertex);
+    blob.indexCount = indices.size();
+    blob.mode = mode;
+    blob.silhouetteError = 0.0f;
+
+    // 0xFFFF stays free as the 16-bit restart marker
+    if (vertices.size() <= 0xFFFF)
+    {
+        narrowIndices.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            narrowIndices[i] = indices[i] == primitiveRestartIndex ? 0xFFFF : (unsigned short)indices[i];
+        }
+        blob.indices = narrowIndices.data();
+        blob.indexType = GL_UNSIGNED_SHORT;
+        blob.restartIndex = 0xFFFF;
+    }
+    else
+    {
+        blob.indices = indices.data();
+        blob.indexType = GL_UNSIGNED_INT;
+        blob.restartIndex = primitiveRestartIndex;
+    }
+
+    // strips draw one triangle per index after the first two of each strip
+    blob.triangleCount = indices.size() / 3;
+    if (mode == GL_TRIANGLE_STRIP)
+    {
+        size_t const strips = std::count(indices.begin(), indices.end(), primitiveRestartIndex) + 1;
+        blob.triangleCount = indices.size() - (strips - 1) - strips * 2;
+    }
+    return blob;
+}
+
+// upload an indexed mesh as one interleaved VBO plus an EBO
+void uploadMeshBlob(Mesh &mesh, const MeshBlob &blob, const VertexFormat &format)
+{
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, blob.vertexBytes, blob.vertices, GL_STATIC_DRAW);
+    applyVertexFormat(format);
+
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, blob.indexBytes(), blob.indices, GL_STATIC_DRAW);
+
+    mesh.indexCount = blob.indexCount;
+    mesh.indexType = blob.indexType;
+    mesh.restartIndex = blob.restartIndex;
+    mesh.mode = blob.mode;
+    mesh.triangleCount = blob.triangleCount;
+    mesh.uploadedBytes = blob.vertexBytes + blob.indexBytes();
+    mesh.silhouetteError = blob.silhouetteError;
+}
+
+// on-disk mesh cache: one file per registry key, a fixed header followed by the vertex and index bytes exactly as
+// they go to glBufferData, so a warm load is an mmap and two uploads
+// bump meshCacheVersion whenever a generator, the cache optimiser or a vertex layout changes
+const uint32_t meshCacheVersion = 1;
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexStride;
+    uint64_t vertexBytes;
+    uint64_t indexCount;
+    uint32_t indexType;
+    uint32_t restartIndex;
+    uint32_t mode;
+    uint32_t triangleCount;
+    float silhouetteError;
+    char key[96];
+};
+
+MeshCacheHeader makeMeshCacheHeader(const std::string &key, const MeshBlob &blob, size_t vertexStride)
+{
+    MeshCacheHeader header = {};
+    memcpy(header.magic, "C371MSH", 8);
+    header.version = meshCacheVersion;
+    header.vertexStride = vertexStride;
+    header.vertexBytes = blob.vertexBytes;
+    header.indexCount = blob.indexCount;
+    header.indexType = blob.indexType;
+    header.restartIndex = blob.restartIndex;
+    header.mode = blob.mode;
+    header.triangleCount = blob.triangleCount;
+    header.silhouetteError = blob.silhouetteError;
+    strncpy(header.key, key.c_str(), sizeof(header.key) - 1);
+    return header;
+}
+
+// blob pointing into a mapped cache file, false if the file is missing, stale or truncated
+bool readMeshCache(const MappedFile &file, const std::string &key, size_t vertexStride, MeshBlob &blob)
+{
+    MeshCacheHeader header;
+    if (file.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, "C371MSH", 8) != 0 || header.version != meshCacheVersion ||
+        header.vertexStride != vertexStride || key != std::string(header.key, strnlen(header.key, sizeof(header.key))))
+    {
+        return false;
+    }
+
+    blob.vertices = file.data() + sizeof(header);
+    blob.vertexBytes = header.vertexBytes;
+    blob.indexCount = header.indexCount;
+    blob.indexType = header.indexType;
+    blob.restartIndex = header.restartIndex;
+    blob.mode = header.mode;
+    blob.triangleCount = header.triangleCount;
+    blob.silhouetteError = header.silhouetteError;
+    blob.indices = file.data() + sizeof(header) + header.vertexBytes;
+    return file.size() == sizeof(header) + blob.vertexBytes + blob.indexBytes();
+}
+
+// written under a temporary name and renamed, so a crash never leaves a half-written file behind
+bool writeMeshCache(const std::string &path, const std::string &key, const MeshBlob &blob, size_t vertexStride)
+{
+    MeshCacheHeader const header = makeMeshCacheHeader(key, blob, vertexStride);
+    MappedFile file;
+    if (!file.create(path + ".tmp", sizeof(header) + blob.vertexBytes + blob.indexBytes()))
+    {
+        return false;
+    }
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), blob.vertices, blob.vertexBytes);
+    memcpy(file.data() + sizeof(header) + blob.vertexBytes, blob.indices, blob.indexBytes());
+    file.close();
+    return std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
+// packs the vertices and narrows the indices with packMesh, then hands the result to uploadMeshBlob
+template <typename Vertex>
+void uploadMesh(Mesh &mesh, const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, GLenum mode)
+{
+    std::vector<unsigned short> narrowIndices;
+    uploadMeshBlob(mesh, packMesh(vertices, indices, mode, narrowIndices), Vertex::format());
+}
+
+void drawMesh(const Mesh &mesh)
+{
+    glBindVertexArray(mesh.vao);
+    if (mesh.mode == GL_TRIANGLE_STRIP)
+    {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(mesh.restartIndex);
+        glDrawElements(mesh.mode, mesh.indexCount, mesh.indexType, 0);
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+    else
+    {
+        glDrawElements(mesh.mode, mesh.indexCount, mesh.indexType, 0);
+    }
+}
+
+// dense UV sphere uploaded without any CPU-side copy: both buffers are allocated at their final size, mapped,
+// and filled in row bands on the pool; at this size indices are always 32-bit
+const size_t mappedSphereVertexCount = 1 << 20;
+
+template <typename Vertex>
+void uploadSphereMapped(Mesh &mesh, unsigned int rings, unsigned int sectors, GLenum mode, ThreadPool &pool)
+{
+    size_t const vertexBytes = size_t(rings) * sectors * sizeof(Vertex);
+    size_t const indexCount = sphereIndexCount(rings, sectors, mode);
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+    applyVertexFormat(Vertex::format());
+
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+    GLbitfield const access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    Vertex *vertices = (Vertex *)glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes, access);
+    unsigned int *indices =
+        vertices ? (unsigned int *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), access)
+                 : nullptr;
+    bool written = vertices && indices;
+    if (written)
+    {
+        generateSphereParallel(rings, sectors, mode, vertices, indices, pool);
+    }
+    // each buffer that did map is unmapped on its own, false means the driver lost what was written
+    if (vertices && !glUnmapBuffer(GL_ARRAY_BUFFER))
+    {
+        written = false;
+    }
+    if (indices && !glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER))
+    {
+        written = false;
+    }
+
+    // a failed map or a lost mapping falls back to generating into client memory and a plain glBufferData
+    if (!written)
+    {
+        std::cerr << "Mapped upload failed for sphere " << rings << "x" << sectors << ", uploading a copy" << std::endl;
+        std::vector<Vertex> vertexCopy(size_t(rings) * sectors);
+        std::vector<unsigned int> indexCopy(indexCount);
+        generateSphereParallel(rings, sectors, mode, vertexCopy.data(), indexCopy.data(), pool);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexCopy.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexCopy.data(), GL_STATIC_DRAW);
+    }
+
+    mesh.indexCount = indexCount;
+    mesh.indexType = GL_UNSIGNED_INT;
+    mesh.restartIndex = primitiveRestartIndex;
+    mesh.mode = mode;
+    mesh.triangleCount = (rings - 1) * (sectors - 1) * 2;
+    mesh.uploadedBytes = vertexBytes + indexCount * sizeof(unsigned int);
+    mesh.silhouetteError = uvSphereSilhouetteError(rings, sectors);
+}
+
+// hands out shared meshes keyed by generator parameters and vertex layout
+// a mesh is generated and uploaded on first request and freed when its last handle goes away
+class MeshRegistry
+{
+public:
+    // meshes are cached on disk under cacheDirectory, an empty directory disables the cache
+    explicit MeshRegistry(const std::string &cacheDirectory = "") : cacheDirectory(cacheDirectory)
+    {
+        std::error_code error;
+        if (!cacheDirectory.empty() && !std::filesystem::create_directories(cacheDirectory, error) && error)
+        {
+            std::cerr << "Mesh cache disabled, cannot create " << cacheDirectory << ": " << error.message() << std::endl;
+            this->cacheDirectory.clear();
+        }
+    }
+
+    // mode is GL_TRIANGLES or GL_TRIANGLE_STRIP
+    template <typename Vertex>
+    MeshHandle sphere(unsigned int rings, unsigned int sectors, GLenum mode = GL_TRIANGLES)
+    {
+        std::string key = "uvsphere-" + std::to_string(rings) + "x" + std::to_string(sectors) + "-" + Vertex::layoutName();
+        if (mode == GL_TRIANGLE_STRIP)
+        {
+            key += "-strip";
+        }
+
+        // dense spheres skip the CPU copy and the cache optimiser, they are generated in parallel into mapped buffers
+        if (size_t(rings) * sectors >= mappedSphereVertexCount)
+        {
+            MeshHandle mesh = find(key);
+            if (!mesh)
+            {
+                mesh = std::make_shared<Mesh>();
+                if (cacheDirectory.empty() || !loadCached(*mesh, key, sizeof(Vertex), Vertex::format()))
+                {
+                    uploadDenseSphere<Vertex>(*mesh, key, rings, sectors, mode);
+                }
+                remember(key, mesh);
+            }
+            return mesh;
+        }
+
+        return acquire<Vertex>(key, mode, [=](std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+            generateSphere(rings, sectors, vertices, indices);
+            if (mode == GL_TRIANGLE_STRIP)
+            {
+                generateSphereStripIndices(rings, sectors, indices);
+            }
+            return uvSphereSilhouetteError(rings, sectors);
+        });
+    }
+
+    template <typename Vertex>
+    MeshHandle icosphere(unsigned int subdivisions)
+    {
+        std::string key = "icosphere-" + std::to_string(subdivisions) + "-" + Vertex::layoutName();
+        return acquire<Vertex>(key, GL_TRIANGLES, [=](std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+            generateIcosphere(subdivisions, vertices, indices);
+            return sphereSilhouetteError(vertices, indices);
+        });
+    }
+
+    // sphere for the textured bodies, with float or quantized vertices
+    MeshHandle texturedSphere(unsigned int rings, unsigned int sectors, GLenum mode, bool quantized)
+    {
+        return quantized ? sphere<PackedPositionUV>(rings, sectors, mode) : sphere<PositionUV>(rings, sectors, mode);
+    }
+
+    MeshHandle texturedIcosphere(unsigned int subdivisions, bool quantized)
+    {
+        return quantized ? icosphere<PackedPositionUV>(subdivisions) : icosphere<PositionUV>(subdivisions);
+    }
+
+    // generate fills the vertices and indices and returns their sphereSilhouetteError
+    template <typename Vertex, typename Generator>
+    MeshHandle acquire(const std::string &key, GLenum mode, Generator generate)
+    {
+        MeshHandle mesh = find(key);
+        if (mesh)
+        {
+            return mesh;
+        }
+
+        mesh = std::make_shared<Mesh>();
+        if (!cacheDirectory.empty() && loadCached(*mesh, key, sizeof(Vertex), Vertex::format()))
+        {
+            remember(key, mesh);
+            return mesh;
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        float const silhouetteError = generate(vertices, indices);
+        if (mode == GL_TRIANGLES)
+        {
+            optimizeVertexCache(indices, vertices.size());
+        }
+
+        std::vector<unsigned short> narrowIndices;
+        MeshBlob blob = packMesh(vertices, indices, mode, narrowIndices);
+        blob.silhouetteError = silhouetteError;
+        uploadMeshBlob(*mesh, blob, Vertex::format());
+        if (!cacheDirectory.empty())
+        {
+            cacheMisses++;
+            if (!writeMeshCache(cachePath(key), key, blob, sizeof(Vertex)))
+            {
+                std::cerr << "Failed to write mesh cache " << cachePath(key) << std::endl;
+            }
+        }
+        remember(key, mesh);
+        return mesh;
+    }
+
+    void printStats() const
+    {
+        std::cout << "mesh registry: " << requestCount << " requests, " << uploadCount << " uploads, "
+                  << uploadedBytes / 1024 << " KB uploaded";
+        if (!cacheDirectory.empty())
+        {
+            std::cout << ", disk cache " << cacheHits << " hits / " << cacheMisses << " misses";
+        }
+        std::cout << std::endl;
+    }
+
+    unsigned int cacheHitCount() const
+    {
+        return cacheHits;
+    }
+
+    unsigned int cacheMissCount() const
+    {
+        return cacheMisses;
+    }
+
+private:
+    MeshHandle find(const std::string &key)
+    {
+        requestCount++;
+        return meshes[key].lock();
+    }
+
+    std::string cachePath(const std::string &key) const
+    {
+        return cacheDirectory + "/" + key + ".mesh";
+    }
+
+    // upload straight from the mapped cache file, no copy on the CPU side
+    bool loadCached(Mesh &mesh, const std::string &key, size_t vertexStride, const VertexFormat &format)
+    {
+        MappedFile file;
+        MeshBlob blob;
+        if (!file.openRead(cachePath(key)) || !readMeshCache(file, key, vertexStride, blob))
+        {
+            return false;
+        }
+        uploadMeshBlob(mesh, blob, format);
+        cacheHits++;
+        return true;
+    }
+
+    // with the cache on, a dense sphere is generated in parallel straight into a mapped cache file and uploaded from
+    // there; without it, straight into mapped GL buffers
+    template <typename Vertex>
+    void uploadDenseSphere(Mesh &mesh, const std::string &key, unsigned int rings, unsigned int sectors, GLenum mode)
+    {
+        if (cacheDirectory.empty())
+        {
+            uploadSphereMapped<Vertex>(mesh, rings, sectors, mode, workerPool());
+            return;
+        }
+
+        MeshBlob blob;
+        blob.vertexBytes = size_t(rings) * sectors * sizeof(Vertex);
+        blob.indexCount = sphereIndexCount(rings, sectors, mode);
+        blob.indexType = GL_UNSIGNED_INT;
+        blob.restartIndex = primitiveRestartIndex;
+        blob.mode = mode;
+        blob.triangleCount = (rings - 1) * (sectors - 1) * 2;
+        blob.silhouetteError = uvSphereSilhouetteError(rings, sectors);
+
+        MeshCacheHeader const header = makeMeshCacheHeader(key, blob, sizeof(Vertex));
+        std::string const path = cachePath(key);
+        MappedFile file;
+        if (!file.create(path + ".tmp", sizeof(header) + blob.vertexBytes + blob.indexBytes()))
+        {
+            std::cerr << "Failed to write mesh cache " << path << std::endl;
+            uploadSphereMapped<Vertex>(mesh, rings, sectors, mode, workerPool());
+            return;
+        }
+
+        memcpy(file.data(), &header, sizeof(header));
+        Vertex *vertices = (Vertex *)(file.data() + sizeof(header));
+        unsigned int *indices = (unsigned int *)(file.data() + sizeof(header) + blob.vertexBytes);
+        generateSphereParallel(rings, sectors, mode, vertices, indices, workerPool());
+        blob.vertices = vertices;
+        blob.indices = indices;
+        uploadMeshBlob(mesh, blob, Vertex::format());
+        cacheMisses++;
+
+        file.close();
+        if (std::rename((path + ".tmp").c_str(), path.c_str()) != 0)
+        {
+            std::cerr << "Failed to write mesh cache " << path << std::endl;
+        }
+    }
+
+    void remember(const std::string &key, const MeshHandle &mesh)
+    {
+        meshes[key] = mesh;
+        uploadCount++;
+        uploadedBytes += mesh->uploadedBytes;
+    }
+
+    std::map<std::string, std::weak_ptr<Mesh>> meshes;
+    unsigned int requestCount = 0;
+    unsigned int uploadCount = 0;
+    size_t uploadedBytes = 0;
+    std::string cacheDirectory;
+    unsigned int cacheHits = 0;
+    unsigned int cacheMisses = 0;
+};
+
+// one level of a sphere LOD chain
+struct LODLevel
+{
+    MeshHandle mesh;
+    unsigned int tessellation; // rings = sectors for UV spheres, subdivisions for icospheres
+    float silhouetteError;     // of the registered mesh, see sphereSilhouetteError
+};
+
+// the same sphere at decreasing tessellation, finest level first
+struct LODChain
+{
+    std::vector<LODLevel> levels;
+
+    // coarsest level whose silhouette stays within maxPixelError of the true sphere at this projected radius
+    const LODLevel &select(float projectedRadius, float maxPixelError) const
+    {
+        for (size_t i = levels.size() - 1; i > 0; --i)
+        {
+            if (levels[i].silhouetteError * projectedRadius <= maxPixelError)
+            {
+                return levels[i];
+            }
+        }
+        return levels.front();
+    }
+};
+
+LODChain createUVSphereLODChain(MeshRegistry &registry, const std::vector<unsigned int> &tessellations, GLenum mode,
+                                bool quantized)
+{
+    LODChain chain;
+    for (unsigned int tessellation : tessellations)
+    {
+        MeshHandle const mesh = registry.texturedSphere(tessellation, tessellation, mode, quantized);
+        chain.levels.push_back({mesh, tessellation, mesh->silhouetteError});
+    }
+    return chain;
+}
+
+LODChain createIcosphereLODChain(MeshRegistry &registry, const std::vector<unsigned int> &subdivisions, bool quantized)
+{
+    LODChain chain;
+    for (unsigned int level : subdivisions)
+    {
+        MeshHandle const mesh = registry.texturedIcosphere(level, quantized);
+        chain.levels.push_back({mesh, level, mesh->silhouetteError});
+    }
+    return chain;
+}
+
+// radius in pixels of a unit sphere drawn with worldMatrix
+// huge when the sphere reaches the camera plane, so the finest level is used up close, and 0 when it is all behind
+float projectedSphereRadius(const mat4 &worldMatrix, const mat4 &viewMatrix, const mat4 &projectionMatrix, float viewportHeight)
+{
+    float const radius = std::max(length(vec3(worldMatrix[0])), std::max(length(vec3(worldMatrix[1])), length(vec3(worldMatrix[2]))));
+    vec4 const center = viewMatrix * worldMatrix * vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float const distance = -center.z;
+    if (distance < -radius)
+    {
+        return 0.0f;
+    }
+    if (distance <= radius)
+    {
+        return 1e9f;
+    }
+    return radius * projectionMatrix[1][1] / distance * viewportHeight * 0.5f;
+}
+
+// times generateSphere at the tessellation we ship and at close-up tessellation
+void benchmarkSphereGeneration()
+{
+    struct Case
+    {
+        unsigned int rings, sectors, iterations;
+    };
+    Case const cases[] = {{40, 40, 2000}, {4096, 4096, 3}};
+
+    for (const Case &c : cases)
+    {
+        size_t vertexCount = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < c.iterations; ++i)
+        {
+            std::vector<PositionUV> vertices;
+            std::vector<unsigned int> indices;
+            generateSphere(c.rings, c.sectors, vertices, indices);
+            vertexCount += vertices.size();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "sphere " << c.rings << "x" << c.sectors << ": " << c.iterations << " runs, "
+                  << seconds * 1000.0 / c.iterations << " ms/run, " << vertexCount / seconds / 1e6 << " Mvertices/s"
+                  << std::endl;
+    }
+}
+
+// compiled texture container, written by --compile-textures and loaded in place of the source image
+// header, then one LevelEntry per mip, then the level data; all offsets are from the start of the file
+// bump textureContainerVersion whenever the encoder or the mip filter changes
+const uint32_t textureContainerVersion = 2;
+
+enum TextureContainerFormat : uint32_t
+{
+    TextureFormatBC1 = 1, // 4x4 blocks of 8 bytes, RGB only
+};
+
+struct TextureContainerHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t reserved;
+};
+
+struct TextureContainerLevel
+{
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+std::string compiledTexturePath(const std::string &source)
+{
+    return "cache/" + source + ".tex";
+}
+
+// sRGB <-> linear conversion tables for mip filtering, built once on first use
+// decoding is exact per 8-bit code; encoding indexes a 16-bit quantised linear value, fine enough that every code
+// round-trips
+const float *srgbToLinearTable()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> values(256);
+        for (int i = 0; i < 256; ++i)
+        {
+            float const c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+const unsigned char *linearToSRGBTable()
+{
+    static const std::vector<unsigned char> table = [] {
+        std::vector<unsigned char> values(65536);
+        for (int i = 0; i < 65536; ++i)
+        {
+            float const l = i / 65535.0f;
+            float const c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            values[i] = (unsigned char)std::round(c * 255.0f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+// RGB mip chains, stored level after level in one tightly packed buffer
+int mipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+    {
+        levels++;
+    }
+    return levels;
+}
+
+size_t mipLevelOffset(int width, int height, int level)
+{
+    size_t offset = 0;
+    for (int i = 0; i < level; ++i)
+    {
+        offset += size_t(std::max(1, width >> i)) * std::max(1, height >> i) * 3;
+    }
+    return offset;
+}
+
+size_t mipChainBytes(int width, int height)
+{
+    return mipLevelOffset(width, height, mipLevelCount(width, height));
+}
+
+// rows [rowBegin, rowEnd) of the next mip level: each texel averages its 2x2 footprint in linear light and is
+// re-encoded to sRGB, so dark and bright detail no longer blend too dark the way an averaging of sRGB bytes does
+// odd edges drop the last row/column, 1-texel sides repeat it
+void downsampleSRGB(const unsigned char *src, int width, int height, unsigned char *dst, size_t rowBegin, size_t rowEnd)
+{
+    const float *toLinear = srgbToLinearTable();
+    const unsigned char *toSRGB = linearToSRGBTable();
+    int const w = std::max(1, width / 2);
+
+    // two source rows in linear light, one spare float so the 4-wide loads of the last texel stay in bounds
+    size_t const rowFloats = size_t(std::max(width, 2)) * 3;
+    std::vector<float> rows(rowFloats * 2 + 1);
+    float *top = rows.data();
+    float *bottom = rows.data() + rowFloats;
+
+    for (size_t y = rowBegin; y < rowEnd; ++y)
+    {
+        const unsigned char *srcTop = src + std::min<size_t>(2 * y, height - 1) * width * 3;
+        const unsigned char *srcBottom = src + std::min<size_t>(2 * y + 1, height - 1) * width * 3;
+        for (size_t i = 0; i < size_t(width) * 3; ++i)
+        {
+            top[i] = toLinear[srcTop[i]];
+            bottom[i] = toLinear[srcBottom[i]];
+        }
+        if (width == 1)
+        {
+            std::copy(top, top + 3, top + 3);
+            std::copy(bottom, bottom + 3, bottom + 3);
+        }
+
+        unsigned char *out = dst + y * w * 3;
+        for (int x = 0; x < w; ++x)
+        {
+            const float *a = top + x * 6;
+            const float *b = bottom + x * 6;
+#if defined(__SSE2__)
+            // lanes 0-2 are the texel's RGB, lane 3 is the neighbour's red and is dropped
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(a + 3)),
+                                    _mm_add_ps(_mm_loadu_ps(b), _mm_loadu_ps(b + 3)));
+            __m128i const index = _mm_cvtps_epi32(_mm_mul_ps(sum, _mm_set1_ps(0.25f * 65535.0f)));
+            alignas(16) int lanes[4];
+            _mm_store_si128((__m128i *)lanes, index);
+            out[x * 3 + 0] = toSRGB[lanes[0]];
+            out[x * 3 + 1] = toSRGB[lanes[1]];
+            out[x * 3 + 2] = toSRGB[lanes[2]];
+#else
+            for (int c = 0; c < 3; ++c)
+            {
+                float const sum = a[c] + a[c + 3] + b[c] + b[c + 3];
+                out[x * 3 + c] = toSRGB[int(std::lrint(sum * 0.25f * 65535.0f))];
+            }
+#endif
+        }
+    }
+}
+
+// fills levels 1.. of a chain whose level 0 is already in place
+// with a pool each level is split into row bands, without one (e.g. from inside a pool task) it runs inline
+void generateMipChain(unsigned char *chain, int width, int height, ThreadPool *pool)
+{
+    int const levels = mipLevelCount(width, height);
+    for (int level = 1; level < levels; ++level)
+    {
+        int const srcWidth = std::max(1, width >> (level - 1));
+        int const srcHeight = std::max(1, height >> (level - 1));
+        const unsigned char *src = chain + mipLevelOffset(width, height, level - 1);
+        unsigned char *dst = chain + mipLevelOffset(width, height, level);
+        size_t const rows = std::max(1, height >> level);
+        if (pool)
+        {
+            pool->parallelFor(rows, [&](size_t begin, size_t end) {
+                downsampleSRGB(src, srcWidth, srcHeight, dst, begin, end);
+            });
+        }
+        else
+        {
+            downsampleSRGB(src, srcWidth, srcHeight, dst, 0, rows);
+        }
+    }
+}
+
+unsigned short packRGB565(vec3 color)
+{
+    int const r = std::round(glm::clamp(color.x, 0.0f, 255.0f) * 31.0f / 255.0f);
+    int const g = std::round(glm::clamp(color.y, 0.0f, 255.0f) * 63.0f / 255.0f);
+    int const b = std::round(glm::clamp(color.z, 0.0f, 255.0f) * 31.0f / 255.0f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+vec3 unpackRGB565(unsigned short color)
+{
+    int const r = (color >> 11) & 31;
+    int const g = (color >> 5) & 63;
+    int const b = color & 31;
+    return vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 1));
+}
+
+// BC1 block for 16 RGB texels: endpoints span the block's principal axis, every texel picks the nearest of the
+// four palette colours; always the 4-colour mode, so no texel is ever punched out
+void encodeBC1Block(const vec3 texels[16], unsigned char block[8])
+{
+    vec3 mean(0.0f);
+    for (int i = 0; i < 16; ++i)
+    {
+        mean += texels[i];
+    }
+    mean = mean / 16.0f;
+
+    // principal axis by power iteration on the covariance
+    float xx = 0.0f, xy = 0.0f, xz = 0.0f, yy = 0.0f, yz = 0.0f, zz = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        vec3 const d = texels[i] - mean;
+        xx += d.x * d.x;
+        xy += d.x * d.y;
+        xz += d.x * d.z;
+        yy += d.y * d.y;
+        yz += d.y * d.z;
+        zz += d.z * d.z;
+    }
+    vec3 axis(1.0f, 1.0f, 1.0f);
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        axis = vec3(xx * axis.x + xy * axis.y + xz * axis.z, xy * axis.x + yy * axis.y + yz * axis.z,
+                    xz * axis.x + yz * axis.y + zz * axis.z);
+        float const length = glm::length(axis);
+        if (length < 1e-6f)
+        {
+            axis = vec3(0.0f);
+            break;
+        }
+        axis = axis / length;
+    }
+
+    float lowest = 0.0f;
+    float highest = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float const t = dot(texels[i] - mean, axis);
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+
+    unsigned short color0 = packRGB565(mean + axis * highest);
+    unsigned short color1 = packRGB565(mean + axis * lowest);
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    unsigned int selectors = 0;
+    if (color0 != color1)
+    {
+        vec3 const c0 = unpackRGB565(color0);
+        vec3 const c1 = unpackRGB565(color1);
+        vec3 const palette[4] = {c0, c1, (2.0f * c0 + c1) / 3.0f, (c0 + 2.0f * c1) / 3.0f};
+        for (int i = 0; i < 16; ++i)
+        {
+            unsigned int best = 0;
+            float bestDistance = std::numeric_limits<float>::max();
+            for (unsigned int p = 0; p < 4; ++p)
+            {
+                vec3 const d = texels[i] - palette[p];
+                float const distance = dot(d, d);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            selectors |= best << (2 * i);
+        }
+    }
+
+    block[0] = color0 & 0xFF;
+    block[1] = color0 >> 8;
+    block[2] = color1 & 0xFF;
+    block[3] = color1 >> 8;
+    memcpy(block + 4, &selectors, 4);
+}
+
+// block rows [blockRowBegin, blockRowEnd) of the BC1 encoding of an RGB level
+// partial blocks at the edges repeat the last row/column
+void encodeBC1(const unsigned char *rgb, int width, int height, unsigned char *blocks, size_t blockRowBegin,
+               size_t blockRowEnd)
+{
+    int const blocksX = (width + 3) / 4;
+    for (int by = blockRowBegin; by < int(blockRowEnd); ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            vec3 texels[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                int const x = std::min(bx * 4 + i % 4, width - 1);
+                int const y = std::min(by * 4 + i / 4, height - 1);
+                const unsigned char *p = rgb + (size_t(y) * width + x) * 3;
+                texels[i] = vec3(p[0], p[1], p[2]);
+            }
+            encodeBC1Block(texels, blocks + (size_t(by) * blocksX + bx) * 8);
+        }
+    }
+}
+
+// CPU decode for drivers without S3TC
+void decodeBC1(const unsigned char *blocks, int width, int height, unsigned char *rgb)
+{
+    int const blocksX = (width + 3) / 4;
+    int const blocksY = (height + 3) / 4;
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            const unsigned char *block = blocks + (size_t(by) * blocksX + bx) * 8;
+            unsigned short const color0 = block[0] | (block[1] << 8);
+            unsigned short const color1 = block[2] | (block[3] << 8);
+            unsigned int selectors;
+            memcpy(&selectors, block + 4, 4);
+
+            vec3 const c0 = unpackRGB565(color0);
+            vec3 const c1 = unpackRGB565(color1);
+            vec3 palette[4] = {c0, c1, (2.0f * c0 + c1) / 3.0f, (c0 + 2.0f * c1) / 3.0f};
+            if (color0 <= color1)
+            {
+                palette[2] = (c0 + c1) * 0.5f;
+                palette[3] = vec3(0.0f);
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int const x = bx * 4 + i % 4;
+                int const y = by * 4 + i / 4;
+                if (x < width && y < height)
+                {
+                    vec3 const color = palette[(selectors >> (2 * i)) & 3];
+                    unsigned char *p = rgb + (size_t(y) * width + x) * 3;
+                    p[0] = (unsigned char)std::round(color.x);
+                    p[1] = (unsigned char)std::round(color.y);
+                    p[2] = (unsigned char)std::round(color.z);
+                }
+            }
+        }
+    }
+}
+
+size_t bc1LevelSize(int width, int height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+// source image to a BC1 container with a full mip chain; returns the GPU bytes of the result, 0 on failure
+// mips and blocks of each level are split across the pool
+size_t compileTexture(const std::string &source, const std::string &destination, ThreadPool &pool)
+{
+    int width, height;
+    unsigned char *decoded = loadImage(source, &width, &height, 3);
+    if (!decoded)
+    {
+        std::cerr << "Failed to load texture: " << source << std::endl;
+        return 0;
+    }
+
+    unsigned int const levelCount = mipLevelCount(width, height);
+
+    std::vector<TextureContainerLevel> levels(levelCount);
+    uint64_t offset = sizeof(TextureContainerHeader) + levelCount * sizeof(TextureContainerLevel);
+    for (unsigned int level = 0; level < levelCount; ++level)
+    {
+        levels[level].width = std::max(1, width >> level);
+        levels[level].height = std::max(1, height >> level);
+        levels[level].size = bc1LevelSize(levels[level].width, levels[level].height);
+        levels[level].offset = offset;
+        offset += levels[level].size;
+    }
+
+    std::filesystem::create_directories(std::filesystem::path(destination).parent_path());
+    MappedFile file;
+    if (!file.create(destination + ".tmp", offset))
+    {
+        std::cerr << "Failed to write texture container " << destination << std::endl;
+        stbi_image_free(decoded);
+        return 0;
+    }
+
+    TextureContainerHeader header = {};
+    memcpy(header.magic, "C371TEX", 8);
+    header.version = textureContainerVersion;
+    header.format = TextureFormatBC1;
+    header.width = width;
+    header.height = height;
+    header.levelCount = levelCount;
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), levels.data(), levelCount * sizeof(TextureContainerLevel));
+
+    std::vector<unsigned char> chain(mipChainBytes(width, height));
+    std::copy(decoded, decoded + size_t(width) * height * 3, chain.begin());
+    stbi_image_free(decoded);
+    generateMipChain(chain.data(), width, height, &pool);
+    for (unsigned int level = 0; level < levelCount; ++level)
+    {
+        const TextureContainerLevel &entry = levels[level];
+        const unsigned char *rgb = chain.data() + mipLevelOffset(width, height, level);
+        pool.parallelFor((entry.height + 3) / 4, [&](size_t begin, size_t end) {
+            encodeBC1(rgb, entry.width, entry.height, file.data() + entry.offset, begin, end);
+        });
+    }
+
+    file.close();
+    std::rename((destination + ".tmp").c_str(), destination.c_str());
+    return offset - levels[0].offset;
+}
+
+// compiles every jpg/png under textures/ into cache/textures/, one file after another with the work of each split
+// across the pool
+// every jpg/png under textures/, sorted; empty when the directory cannot be read
+std::vector<std::string> listTextureSources()
+{
+    std::vector<std::string> sources;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator("textures", error))
+    {
+        std::string const extension = entry.path().extension().string();
+        if (entry.is_regular_file() && (extension == ".jpg" || extension == ".png"))
+        {
+            sources.push_back(entry.path().generic_string());
+        }
+    }
+    if (error)
+    {
+        std::cerr << "Failed to list textures/: " << error.message() << std::endl;
+        return {};
+    }
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
+
+// decode throughput of every texture through stdio reads, the mapped loader, and the mapped loader with pooled buffers
+// each file is decoded once beforehand so all three see a warm page cache and time the read path, not the disk
+void benchmarkImageDecode()
+{
+    struct Path
+    {
+        const char *name;
+        bool mapped;
+        bool pooled;
+    };
+    Path const paths[] = {{"stdio", false, false}, {"mmap", true, false}, {"mmap+pool", true, true}};
+    int const iterations = 8;
+
+    double totalSeconds[3] = {};
+    size_t totalBytes = 0;
+    for (const std::string &source : listTextureSources())
+    {
+        std::error_code error;
+        size_t const fileBytes = std::filesystem::file_size(source, error);
+        int width, height;
+        stbi_image_free(loadImage(source, &width, &height, 3));
+        totalBytes += fileBytes * iterations;
+
+        std::cout << source << " (" << fileBytes / 1024 << " KB):";
+        for (int p = 0; p < 3; ++p)
+        {
+            imagePoolEnabled = paths[p].pooled;
+            auto const start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                unsigned char *pixels = paths[p].mapped ? loadImage(source, &width, &height, 3)
+                                                        : stbi_load(source.c_str(), &width, &height, nullptr, 3);
+                stbi_image_free(pixels);
+            }
+            double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            totalSeconds[p] += seconds;
+            std::cout << "  " << paths[p].name << " " << seconds * 1000.0 / iterations << " ms";
+        }
+        std::cout << std::endl;
+    }
+
+    for (int p = 0; p < 3; ++p)
+    {
+        std::cout << paths[p].name << ": " << totalBytes / totalSeconds[p] / 1e6 << " MB/s of encoded input" << std::endl;
+    }
+    std::cout << "pooled allocations: " << imagePoolHits << " reused, " << imagePoolMisses << " from malloc, "
+              << imagePoolBytes / 1024 << " KB cached" << std::endl;
+    imagePoolEnabled = true;
+}
+
+void compileTextures()
+{
+    std::vector<std::string> const sources = listTextureSources();
+    for (const std::string &source : sources)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        size_t const gpuBytes = compileTexture(source, compiledTexturePath(source), workerPool());
+        double const milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        int width = 0, height = 0, channels = 0;
+        stbi_info(source.c_str(), &width, &height, &channels);
+        // what the runtime used to keep resident: RGBA8 after the driver's RGB expansion, plus mips
+        size_t const uncompressedBytes = size_t(width) * height * 4 * 4 / 3;
+        if (gpuBytes > 0)
+        {
+            std::cout << source << " -> " << compiledTexturePath(source) << ": " << width << "x" << height << ", BC1 "
+                      << gpuBytes / 1024 << " KB vs " << uncompressedBytes / 1024 << " KB RGBA8, " << milliseconds
+                      << " ms" << std::endl;
+        }
+    }
+}
+
+// what ended up on the GPU for a 2D texture, levelCount 0 when the source could not be read
+struct TextureInfo
+{
+    int width = 0;
+    int height = 0;
+    int levelCount = 0;
+    bool compressed = false; // BC1, otherwise RGB8
+};
+
+// maps the compiled container for source and checks it, false when there is none or it is stale
+// a container whose source is gone counts as stale: it can no longer be rebuilt and the source path is the only name it has
+bool openTextureContainer(const std::string &source, MappedFile &file, TextureContainerHeader &header,
+                          std::vector<TextureContainerLevel> &levels)
+{
+    std::string const path = compiledTexturePath(source);
+    std::error_code error;
+    auto const containerTime = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+        return false;
+    }
+    auto const sourceTime = std::filesystem::last_write_time(source, error);
+    if (error || containerTime < sourceTime)
+    {
+        return false;
+    }
+
+    if (!file.openRead(path) || file.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    // the loaders index the table by level and shift the base size down, so it has to be the full chain
+    bool const sizeValid = header.width > 0 && header.height > 0 && header.width <= 16384 && header.height <= 16384;
+    if (memcmp(header.magic, "C371TEX", 8) != 0 || header.version != textureContainerVersion ||
+        header.format != TextureFormatBC1 || !sizeValid ||
+        int(header.levelCount) != mipLevelCount(header.width, header.height) ||
+        file.size() < sizeof(header) + header.levelCount * sizeof(TextureContainerLevel))
+    {
+        std::cerr << "Ignoring stale texture container " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    levels.resize(header.levelCount);
+    memcpy(levels.data(), file.data() + sizeof(header), header.levelCount * sizeof(TextureContainerLevel));
+    for (unsigned int i = 0; i < levels.size(); ++i)
+    {
+        const TextureContainerLevel &level = levels[i];
+        if (level.width != std::max(1u, header.width >> i) || level.height != std::max(1u, header.height >> i) ||
+            level.size != bc1LevelSize(level.width, level.height) || level.size > file.size() ||
+            level.offset > file.size() - level.size)
+        {
+            std::cerr << "Ignoring truncated texture container " << path << std::endl;
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+// rows [row, row + rows) of one container level, as BC1 or decoded on the CPU for drivers without S3TC
+// row is a multiple of 4 and rows is too unless the band ends at the bottom edge
+// the whole level in one band allocates it, a partial band needs the level allocated beforehand
+void uploadContainerRows(GLenum target, int levelIndex, const TextureContainerLevel &level, const unsigned char *file,
+                         int row, int rows, bool compressed)
+{
+    const unsigned char *blocks = file + level.offset + size_t(row / 4) * ((level.width + 3) / 4) * 8;
+    bool const wholeLevel = row == 0 && rows == int(level.height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (compressed)
+    {
+        size_t const bytes = bc1LevelSize(level.width, rows);
+        if (wholeLevel)
+        {
+            glCompressedTexImage2D(target, levelIndex, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, level.width, level.height, 0,
+                                   bytes, blocks);
+        }
+        else
+        {
+            glCompressedTexSubImage2D(target, levelIndex, 0, row, level.width, rows, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                                      bytes, blocks);
+        }
+    }
+    else
+    {
+        std::vector<unsigned char> rgb(size_t(level.width) * rows * 3);
+        decodeBC1(blocks, level.width, rows, rgb.data());
+        if (wholeLevel)
+        {
+            glTexImage2D(target, levelIndex, GL_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+        }
+        else
+        {
+            glTexSubImage2D(target, levelIndex, 0, row, level.width, rows, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// 2D textures that come up at a small mip right away and refine level by level in the background
+// a compiled container is mapped and its small tail levels are uploaded inside request(); anything else shows a 1x1
+// grey placeholder while the worker pool decodes it and builds its mip chain straight into a mapped pixel-unpack buffer
+// pumpUploads() then streams the larger levels in row bands under a per-frame time budget, moving
+// GL_TEXTURE_BASE_LEVEL down as each level completes, and reports when a texture reaches full resolution
+class AsyncTextureLoader
+{
+public:
+    explicit AsyncTextureLoader(ThreadPool &pool) : pool(pool)
+    {
+    }
+
+    AsyncTextureLoader(const AsyncTextureLoader &) = delete;
+    AsyncTextureLoader &operator=(const AsyncTextureLoader &) = delete;
+
+    // decodes write into mapped buffers, so they must not outlive the loader
+    ~AsyncTextureLoader()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        decoded.wait(lock, [this] { return inFlight == 0; });
+    }
+
+    // the mapped buffers die with the context: before it goes, the decodes still running are waited for, and every
+    // texture not at full resolution yet has its staging buffer unmapped and deleted and its container closed
+    void release()
+    {
+        std::deque<std::shared_ptr<Job>> stillMapped;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            decoded.wait(lock, [this] { return inFlight == 0; });
+            stillMapped.swap(finished);
+        }
+        for (const std::shared_ptr<Job> &job : stillMapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (const std::shared_ptr<Job> &job : streaming)
+        {
+            glDeleteBuffers(1, &job->pbo);
+            job->pbo = 0;
+            job->container.close();
+        }
+        streaming.clear();
+    }
+
+    GLuint request(const char *path, TextureInfo *info = nullptr)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->path = path;
+        job->texture = texture;
+        job->requested = std::chrono::steady_clock::now();
+
+        TextureContainerHeader header;
+        if (openTextureContainer(path, job->container, header, job->containerLevels))
+        {
+            job->width = header.width;
+            job->height = header.height;
+            job->compressed = GLEW_EXT_texture_compression_s3tc;
+            job->succeeded = true;
+            start(job);
+            showTail(job);
+        }
+        else
+        {
+            unsigned char const placeholder[3] = {128, 128, 128};
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+            // only the header is read here, the staging buffer has to be sized and mapped on the GL thread
+            int channels;
+            if (!stbi_info(path, &job->width, &job->height, &channels))
+            {
+                std::cerr << "Failed to load texture: " << path << std::endl;
+                return texture;
+            }
+            if (!decode(job))
+            {
+                return texture;
+            }
+        }
+
+        if (info)
+        {
+            info->width = job->width;
+            info->height = job->height;
+            info->levelCount = mipLevelCount(job->width, job->height);
+            info->compressed = job->compressed;
+        }
+        return texture;
+    }
+
+    // called once per frame on the GL thread: finished decodes put up their tail levels, then every streaming
+    // texture gets one band of its next level in turn until budgetMs is spent
+    // at least one band goes through per call so a tiny budget still makes progress
+    void pumpUploads(double budgetMs)
+    {
+        auto const frameStart = std::chrono::steady_clock::now();
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (finished.empty())
+                {
+                    break;
+                }
+                job = finished.front();
+                finished.pop_front();
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (job->succeeded)
+            {
+                showTail(job);
+            }
+            else
+            {
+                std::cerr << "Failed to load texture: " << job->path << std::endl;
+                complete(*job);
+            }
+        }
+
+        while (!streaming.empty())
+        {
+            for (auto it = streaming.begin(); it != streaming.end();)
+            {
+                if ((*it)->decoding)
+                {
+                    ++it;
+                    continue;
+                }
+                streamBand(**it);
+                if ((*it)->baseLevel == 0)
+                {
+                    complete(**it);
+                    it = streaming.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            bool const anyReady = std::any_of(streaming.begin(), streaming.end(), [](const std::shared_ptr<Job> &job) {
+                return !job->decoding;
+            });
+            if (!anyReady ||
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count() >= budgetMs)
+            {
+                return;
+            }
+        }
+    }
+
+    // textures not yet at full resolution
+    unsigned int pendingCount() const
+    {
+        return streaming.size();
+    }
+
+    bool isLoading(GLuint texture) const
+    {
+        return std::any_of(streaming.begin(), streaming.end(), [texture](const std::shared_ptr<Job> &job) {
+            return job->texture == texture;
+        });
+    }
+
+private:
+    // levels no larger than this on either side come up in one go
+    static const int tailSize = 64;
+    // source bytes per streamed band, small enough for a band never to stall a frame
+    static const size_t bandBytes = 512 * 1024;
+
+    struct Job
+    {
+        std::string path;
+        GLuint texture = 0;
+        int width = 0;
+        int height = 0;
+        bool compressed = false;
+        bool succeeded = false;
+        bool decoding = false; // set until the worker finished, GL thread reads it only after the job is handed back
+
+        // decoded sources: the whole mip chain in a pixel-unpack buffer
+        GLuint pbo = 0;
+        void *pixels = nullptr;
+
+        // compiled sources: the mapped container
+        MappedFile container;
+        std::vector<TextureContainerLevel> containerLevels;
+
+        int baseLevel = 0;     // finest complete level
+        int bandRow = 0;       // rows of baseLevel - 1 already streamed
+        std::chrono::steady_clock::time_point requested;
+        double tailMs = 0.0;
+    };
+
+    void start(const std::shared_ptr<Job> &job)
+    {
+        job->baseLevel = mipLevelCount(job->width, job->height);
+        streaming.push_back(job);
+    }
+
+    bool decode(const std::shared_ptr<Job> &job)
+    {
+        size_t const bytes = mipChainBytes(job->width, job->height);
+        glGenBuffers(1, &job->pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        job->pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!job->pixels)
+        {
+            std::cerr << "Failed to map upload buffer for texture: " << job->path << std::endl;
+            glDeleteBuffers(1, &job->pbo);
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight++;
+        }
+        job->decoding = true;
+        start(job);
+        pool.submit([this, job] {
+            // the whole mip chain is built here, already on a worker, so generateMipChain runs inline
+            int width, height;
+            unsigned char *data = loadImage(job->path, &width, &height, 3);
+            job->succeeded = data != nullptr && width == job->width && height == job->height;
+            if (job->succeeded)
+            {
+                memcpy(job->pixels, data, size_t(width) * height * 3);
+                generateMipChain((unsigned char *)job->pixels, width, height, nullptr);
+            }
+            stbi_image_free(data);
+
+            bool idle;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(job);
+                idle = --inFlight == 0;
+                decoded.notify_all();
+            }
+            // last decode of the batch, the workers' cached decode buffers are not needed until the next one
+            if (idle)
+            {
+                imagePoolTrim();
+            }
+        });
+        return true;
+    }
+
+    // every level up to tailSize in one go, the texture samples them from now on
+    void uploadTail(Job &job)
+    {
+        job.decoding = false;
+        int const levelCount = mipLevelCount(job.width, job.height);
+        int tail = 0;
+        while (tail + 1 < levelCount && std::max(job.width, job.height) >> tail > tailSize)
+        {
+            tail++;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        for (int level = levelCount - 1; level >= tail; --level)
+        {
+            uploadRows(job, level, 0, std::max(1, job.height >> level));
+        }
+        job.baseLevel = tail;
+        job.bandRow = 0;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tail);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        job.tailMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.requested).count();
+    }
+
+    // tail levels up; a texture no larger than tailSize is complete with them and leaves the stream right away
+    void showTail(const std::shared_ptr<Job> &job)
+    {
+        uploadTail(*job);
+        if (job->baseLevel == 0)
+        {
+            complete(*job);
+            streaming.remove(job);
+        }
+    }
+
+    // next band of the level above the finest complete one, which takes over once its last band is in
+    void streamBand(Job &job)
+    {
+        if (job.baseLevel <= 0)
+        {
+            return;
+        }
+        int const level = job.baseLevel - 1;
+        int const width = std::max(1, job.width >> level);
+        int const height = std::max(1, job.height >> level);
+        size_t const rowBytes = job.compressed ? bc1LevelSize(width, 4) / 4 : size_t(width) * 3;
+        int const rows = std::min(height - job.bandRow, std::max(4, int(bandBytes / rowBytes) & ~3));
+
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        if (job.bandRow == 0 && rows < height)
+        {
+            allocateLevel(job, level, width, height);
+        }
+        uploadRows(job, level, job.bandRow, rows);
+        job.bandRow += rows;
+        if (job.bandRow == height)
+        {
+            job.baseLevel = level;
+            job.bandRow = 0;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        }
+    }
+
+    void allocateLevel(const Job &job, int level, int width, int height)
+    {
+        if (job.compressed)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, 0,
+                                   bc1LevelSize(width, height), nullptr);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+
+    // rows of one level from the container or the decoded chain, to the texture bound on GL_TEXTURE_2D
+    void uploadRows(const Job &job, int level, int row, int rows)
+    {
+        if (!job.containerLevels.empty())
+        {
+            uploadContainerRows(GL_TEXTURE_2D, level, job.containerLevels[level], job.container.data(), row, rows,
+                                job.compressed);
+            return;
+        }
+
+        int const width = std::max(1, job.width >> level);
+        int const height = std::max(1, job.height >> level);
+        size_t const offset = mipLevelOffset(job.width, job.height, level) + size_t(row) * width * 3;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (row == 0 && rows == height)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, (void *)offset);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, row, width, rows, GL_RGB, GL_UNSIGNED_BYTE, (void *)offset);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // full resolution reached, or the decode failed: staging goes away and the time to here is reported
+    void complete(Job &job)
+    {
+        glDeleteBuffers(1, &job.pbo);
+        job.pbo = 0;
+        job.container.close();
+        if (job.succeeded)
+        {
+            std::cout << "texture " << job.path << ": first mips after " << job.tailMs << " ms, full resolution "
+                      << job.width << "x" << job.height << " after "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.requested).count()
+                      << " ms" << (job.containerLevels.empty() ? "" : " (compiled)") << std::endl;
+        }
+        else
+        {
+            streaming.erase(std::find_if(streaming.begin(), streaming.end(),
+                                         [&job](const std::shared_ptr<Job> &other) { return other.get() == &job; }));
+        }
+    }
+
+    ThreadPool &pool;
+    std::mutex mutex;
+    std::condition_variable decoded;
+    std::deque<std::shared_ptr<Job>> finished;
+    unsigned int inFlight = 0;                   // guarded by mutex
+    std::list<std::shared_ptr<Job>> streaming;   // GL thread only
+};
+
+// 64-bit FNV-1a, chained by passing the previous result as hash
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 1469598103934665603ull)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// FNV-1a over a file's bytes, used to spot the same image under different paths
+uint64_t hashFileContents(const std::string &path)
+{
+    MappedFile file;
+    if (!file.openRead(path))
+    {
+        return 0;
+    }
+    return hashBytes(file.data(), file.size());
+}
+
+// FNV-1a over a file's size and first few KB: one small read, and equal for any two files with the same contents
+uint64_t probeFileContents(const std::string &path)
+{
+    std::error_code error;
+    uint64_t const size = std::filesystem::file_size(path, error);
+    std::ifstream file(path, std::ios::binary);
+    if (error || !file)
+    {
+        return 0;
+    }
+    char head[4096];
+    file.read(head, sizeof(head));
+    return hashBytes(head, file.gcount(), hashBytes(&size, sizeof(size)));
+}
+
+// a managed 2D texture; id may change when the budget drops its top mips or evicts it
+struct Texture
+{
+    GLuint id = 0;
+    std::string path;
+    uint64_t contentProbe = 0;
+    uint64_t contentHash = 0;  // of the whole file, only computed once another file's probe matches
+    TextureInfo info;          // full resolution chain as loaded
+    int topLevel = 0;          // levels above this were dropped to stay within budget
+    bool resident = false;     // false once evicted, reloaded on next use
+    unsigned long long lastUsedFrame = 0;
+
+    Texture() = default;
+    Texture(const Texture &) = delete;
+    Texture &operator=(const Texture &) = delete;
+
+    ~Texture()
+    {
+        if (id != 0)
+        {
+            glDeleteTextures(1, &id);
+        }
+    }
+
+    // bytes the driver holds for the remaining levels, RGB8 counted as the RGBA8 it is stored as
+    size_t residentBytes() const
+    {
+        size_t bytes = 0;
+        for (int level = topLevel; resident && level < info.levelCount; ++level)
+        {
+            int const w = std::max(1, info.width >> level);
+            int const h = std::max(1, info.height >> level);
+            bytes += info.compressed ? bc1LevelSize(w, h) : size_t(w) * h * 4;
+        }
+        return bytes;
+    }
+};
+
+typedef std::shared_ptr<Texture> TextureHandle;
+
+// hands out shared textures keyed by path and by content, so one image under two names is loaded once
+// content is keyed by a cheap probe and only a matching probe pays for hashing both whole files
+// keeps the resident total under budgetBytes at the end of every frame: least recently used textures first lose
+// their top mips, down to minimumSize texels, and are evicted outright once they are that small and went unused
+class TextureManager
+{
+public:
+    TextureManager(ThreadPool &pool, size_t budgetBytes) : loader(pool), budgetBytes(budgetBytes)
+    {
+    }
+
+    TextureHandle acquire(const std::string &path)
+    {
+        requestCount++;
+        TextureHandle texture = byPath[path].lock();
+        if (texture)
+        {
+            return texture;
+        }
+
+        uint64_t const probe = probeFileContents(path);
+        texture = probe ? byContent[probe].lock() : TextureHandle();
+        if (texture && sameContents(*texture, path))
+        {
+            byPath[path] = texture;
+            sharedCount++;
+            return texture;
+        }
+
+        texture = std::make_shared<Texture>();
+        texture->path = path;
+        texture->contentProbe = probe;
+        load(*texture);
+        byPath[path] = texture;
+        if (probe)
+        {
+            byContent[probe] = texture;
+        }
+        return texture;
+    }
+
+    // texture name to bind this frame, reloading the texture if the budget evicted it
+    GLuint use(Texture &texture)
+    {
+        texture.lastUsedFrame = frame;
+        if (!texture.resident && texture.info.levelCount > 0)
+        {
+            glDeleteTextures(1, &texture.id);
+            load(texture);
+            reloadCount++;
+        }
+        return texture.id;
+    }
+
+    // pumps finished decodes and enforces the budget, once per frame on the GL thread
+    void endFrame(double uploadBudgetMs)
+    {
+        loader.pumpUploads(uploadBudgetMs);
+        enforceBudget();
+        frame++;
+    }
+
+    // drains the loader and deletes every texture name while the context is still current
+    // handles outliving this only hold the path, their destructors have nothing left to delete
+    void release()
+    {
+        loader.release();
+        for (const TextureHandle &texture : liveTextures())
+        {
+            glDeleteTextures(1, &texture->id);
+            texture->id = 0;
+            texture->resident = false;
+        }
+    }
+
+    size_t residentBytes()
+    {
+        size_t bytes = 0;
+        for (const TextureHandle &texture : liveTextures())
+        {
+            bytes += texture->residentBytes();
+        }
+        return bytes;
+    }
+
+    void printStats()
+    {
+        std::cout << "texture manager: " << requestCount << " requests, " << liveTextures().size() << " textures ("
+                  << sharedCount << " shared by content), " << residentBytes() / 1024 << " KB resident of "
+                  << budgetBytes / 1024 << " KB budget, " << droppedMipCount << " mips dropped, " << evictionCount
+                  << " evicted, " << reloadCount << " reloaded" << std::endl;
+    }
+
+private:
+    static const int minimumSize = 64;
+
+    // the probes already match, so this is nearly always a real duplicate and the full read is not wasted
+    bool sameContents(Texture &texture, const std::string &path)
+    {
+        if (texture.contentHash == 0)
+        {
+            texture.contentHash = hashFileContents(texture.path);
+        }
+        return texture.contentHash != 0 && texture.contentHash == hashFileContents(path);
+    }
+
+    void load(Texture &texture)
+    {
+        texture.info = TextureInfo();
+        texture.id = loader.request(texture.path.c_str(), &texture.info);
+        texture.topLevel = 0;
+        texture.resident = true;
+    }
+
+    std::vector<TextureHandle> liveTextures()
+    {
+        std::set<Texture *> seen;
+        std::vector<TextureHandle> textures;
+        for (auto it = byPath.begin(); it != byPath.end();)
+        {
+            TextureHandle texture = it->second.lock();
+            if (!texture)
+            {
+                it = byPath.erase(it);
+                continue;
+            }
+            if (seen.insert(texture.get()).second)
+            {
+                textures.push_back(texture);
+            }
+            ++it;
+        }
+        return textures;
+    }
+
+    void enforceBudget()
+    {
+        size_t resident = residentBytes();
+        if (resident <= budgetBytes)
+        {
+            return;
+        }
+
+        // textures still decoding are left alone, their upload would land in a deleted name
+        // at most one texture is rebuilt a level down per frame, evictions cost nothing and are not limited
+        unsigned int const changesBefore = droppedMipCount + evictionCount;
+        bool dropped = false;
+        std::vector<TextureHandle> textures = liveTextures();
+        std::sort(textures.begin(), textures.end(), [](const TextureHandle &a, const TextureHandle &b) {
+            return a->lastUsedFrame < b->lastUsedFrame;
+        });
+        for (const TextureHandle &texture : textures)
+        {
+            while (resident > budgetBytes && texture->resident && !loader.isLoading(texture->id))
+            {
+                size_t const before = texture->residentBytes();
+                int const topSize = std::max(texture->info.width, texture->info.height) >> texture->topLevel;
+                if (topSize > minimumSize)
+                {
+                    if (dropped)
+                    {
+                        break;
+                    }
+                    dropTopLevel(*texture);
+                    droppedMipCount++;
+                    dropped = true;
+                }
+                else if (texture->lastUsedFrame < frame)
+                {
+                    glDeleteTextures(1, &texture->id);
+                    texture->id = 0;
+                    texture->resident = false;
+                    evictionCount++;
+                }
+                else
+                {
+                    break;
+                }
+                resident -= before - texture->residentBytes();
+            }
+        }
+        if (droppedMipCount + evictionCount != changesBefore)
+        {
+            printStats();
+        }
+    }
+
+    // GL 3.2 cannot free single levels, so the remaining chain moves into a new texture one level down: copied on the
+    // GPU with ARB_copy_image, uploaded again from the compiled container, and only read back when there is neither
+    void dropTopLevel(Texture &texture)
+    {
+        GLuint replacement;
+        glGenTextures(1, &replacement);
+        MappedFile container;
+        TextureContainerHeader header;
+        std::vector<TextureContainerLevel> containerLevels;
+        bool const fromContainer = !GLEW_ARB_copy_image &&
+                                   openTextureContainer(texture.path, container, header, containerLevels) &&
+                                   int(header.width) == texture.info.width && int(header.height) == texture.info.height;
+        std::vector<unsigned char> pixels;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = texture.topLevel + 1; level < texture.info.levelCount; ++level)
+        {
+            int const w = std::max(1, texture.info.width >> level);
+            int const h = std::max(1, texture.info.height >> level);
+            GLint const source = level - texture.topLevel;
+            GLint const destination = source - 1;
+
+            if (GLEW_ARB_copy_image)
+            {
+                glBindTexture(GL_TEXTURE_2D, replacement);
+                if (texture.info.compressed)
+                {
+                    glCompressedTexImage2D(GL_TEXTURE_2D, destination, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0,
+                                           bc1LevelSize(w, h), nullptr);
+                }
+                else
+                {
+                    glTexImage2D(GL_TEXTURE_2D, destination, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+                }
+                glCopyImageSubData(texture.id, GL_TEXTURE_2D, source, 0, 0, 0, replacement, GL_TEXTURE_2D, destination, 0, 0,
+                                   0, w, h, 1);
+                continue;
+            }
+            if (fromContainer)
+            {
+                glBindTexture(GL_TEXTURE_2D, replacement);
+                uploadContainerRows(GL_TEXTURE_2D, destination, containerLevels[level], container.data(), 0,
+                                    containerLevels[level].height, texture.info.compressed);
+                continue;
+            }
+
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            if (texture.info.compressed)
+            {
+                pixels.resize(bc1LevelSize(w, h));
+                glGetCompressedTexImage(GL_TEXTURE_2D, source, pixels.data());
+                glBindTexture(GL_TEXTURE_2D, replacement);
+                glCompressedTexImage2D(GL_TEXTURE_2D, destination, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0, pixels.size(),
+                                       pixels.data());
+            }
+            else
+            {
+                pixels.resize(size_t(w) * h * 3);
+                glGetTexImage(GL_TEXTURE_2D, source, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+                glBindTexture(GL_TEXTURE_2D, replacement);
+                glTexImage2D(GL_TEXTURE_2D, destination, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+            }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glBindTexture(GL_TEXTURE_2D, replacement);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glDeleteTextures(1, &texture.id);
+        texture.id = replacement;
+        texture.topLevel++;
+    }
+
+    AsyncTextureLoader loader;
+    size_t budgetBytes;
+    std::map<std::string, std::weak_ptr<Texture>> byPath;
+    std::map<uint64_t, std::weak_ptr<Texture>> byContent;
+    unsigned long long frame = 1;
+    unsigned int requestCount = 0;
+    unsigned int sharedCount = 0;
+    unsigned int droppedMipCount = 0;
+    unsigned int evictionCount = 0;
+    unsigned int reloadCount = 0;
+};
+
+// same-sized body textures as the layers of one GL_TEXTURE_2D_ARRAY, each with its full mip chain
+// layers[i] is the layer of paths[i], -1 when that image failed to load or differs in size from the first one
+// returns 0 without creating anything when no image loaded
+GLuint loadTextureArray(const std::vector<std::string> &paths, std::vector<int> &layers)
+{
+    std::vector<std::vector<unsigned char>> chains(paths.size());
+    std::vector<int> widths(paths.size()), heights(paths.size());
+    workerPool().parallelFor(paths.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            unsigned char *data = loadImage(paths[i], &widths[i], &heights[i], 3);
+            if (data)
+            {
+                chains[i].resize(mipChainBytes(widths[i], heights[i]));
+                std::copy(data, data + size_t(widths[i]) * heights[i] * 3, chains[i].begin());
+                generateMipChain(chains[i].data(), widths[i], heights[i], nullptr);
+            }
+            stbi_image_free(data);
+        }
+    });
+
+    int width = 0, height = 0, layerCount = 0;
+    layers.assign(paths.size(), -1);
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (chains[i].empty())
+        {
+            std::cerr << "Failed to load texture: " << paths[i] << std::endl;
+            continue;
+        }
+        if (layerCount == 0)
+        {
+            width = widths[i];
+            height = heights[i];
+        }
+        if (widths[i] != width || heights[i] != height)
+        {
+            std::cerr << "Texture array: " << paths[i] << " is " << widths[i] << "x" << heights[i] << ", not " << width
+                      << "x" << height << ", left out" << std::endl;
+            continue;
+        }
+        layers[i] = layerCount++;
+    }
+
+    if (layerCount == 0)
+    {
+        std::cerr << "Texture array: no layer loaded, bodies keep their own textures" << std::endl;
+        return 0;
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < mipLevelCount(width, height); ++level)
+    {
+        int const w = std::max(1, width >> level);
+        int const h = std::max(1, height >> level);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB, w, h, layerCount, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (layers[i] >= 0)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layers[i], w, h, 1, GL_RGB, GL_UNSIGNED_BYTE,
+                                chains[i].data() + mipLevelOffset(width, height, level));
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    std::cout << "texture array: " << layerCount << " layers of " << width << "x" << height << ", "
+              << size_t(width) * height * 4 * 4 / 3 * layerCount / 1024 << " KB" << std::endl;
+    return texture;
+}
+
+// virtual textures: a power-of-two source split offline into a file of fixed-size tiles for every mip level
+// at runtime only the tiles the feedback pass saw are copied from the mapped file into a fixed page cache texture,
+// and an indirection texture maps every tile of every level to its page, or to its nearest resident ancestor
+const uint32_t virtualTextureVersion = 1;
+const int virtualTileSize = 128;  // texels of content per tile side
+const int virtualTileBorder = 1;  // texels repeated from the neighbours on each side, for bilinear filtering
+const int virtualPageSize = virtualTileSize + 2 * virtualTileBorder;
+
+struct VirtualTextureHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levelCount;
+};
+
+std::string virtualTexturePath(const std::string &source)
+{
+    return "cache/" + source + ".vt";
+}
+
+// tiles across and down at a level, the last level is a single tile
+int virtualTilesX(int width, int level)
+{
+    return std::max(1, (width >> level) / virtualTileSize);
+}
+
+int virtualTilesY(int height, int level)
+{
+    return std::max(1, (height >> level) / virtualTileSize);
+}
+
+size_t virtualTileIndex(int width, int height, int level, int tileX, int tileY)
+{
+    size_t index = 0;
+    for (int i = 0; i < level; ++i)
+    {
+        index += size_t(virtualTilesX(width, i)) * virtualTilesY(height, i);
+    }
+    return index + size_t(tileY) * virtualTilesX(width, level) + tileX;
+}
+
+// offline: decodes source once, builds its mip chain and writes every tile with its border, edges clamped
+bool buildVirtualTexture(const std::string &source, ThreadPool &pool)
+{
+    int width, height;
+    unsigned char *decoded = loadImage(source, &width, &height, 3);
+    if (!decoded)
+    {
+        std::cerr << "Failed to load texture: " << source << std::endl;
+        return false;
+    }
+    if ((width & (width - 1)) || (height & (height - 1)) || std::min(width, height) < virtualTileSize)
+    {
+        std::cerr << "Virtual textures need power-of-two sides of at least " << virtualTileSize << ": " << source << " is "
+                  << width << "x" << height << std::endl;
+        stbi_image_free(decoded);
+        return false;
+    }
+
+    std::vector<unsigned char> chain(mipChainBytes(width, height));
+    std::copy(decoded, decoded + size_t(width) * height * 3, chain.begin());
+    stbi_image_free(decoded);
+    generateMipChain(chain.data(), width, height, &pool);
+
+    int levelCount = 1;
+    while (std::max(width, height) >> (levelCount - 1) > virtualTileSize)
+    {
+        levelCount++;
+    }
+
+    size_t const pageBytes = size_t(virtualPageSize) * virtualPageSize * 3;
+    size_t const tileCount = virtualTileIndex(width, height, levelCount, 0, 0);
+    std::string const path = virtualTexturePath(source);
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+    MappedFile file;
+    if (!file.create(path + ".tmp", sizeof(VirtualTextureHeader) + tileCount * pageBytes))
+    {
+        std::cerr << "Failed to write virtual texture " << path << std::endl;
+        return false;
+    }
+
+    VirtualTextureHeader header = {};
+    memcpy(header.magic, "C371VTX", 8);
+    header.version = virtualTextureVersion;
+    header.width = width;
+    header.height = height;
+    header.tileSize = virtualTileSize;
+    header.border = virtualTileBorder;
+    header.levelCount = levelCount;
+    memcpy(file.data(), &header, sizeof(header));
+
+    for (int level = 0; level < levelCount; ++level)
+    {
+        int const levelWidth = std::max(1, width >> level);
+        int const levelHeight = std::max(1, height >> level);
+        const unsigned char *texels = chain.data() + mipLevelOffset(width, height, level);
+        int const tilesX = virtualTilesX(width, level);
+        pool.parallelFor(virtualTilesY(height, level), [&](size_t begin, size_t end) {
+            for (size_t tileY = begin; tileY < end; ++tileY)
+            {
+                for (int tileX = 0; tileX < tilesX; ++tileX)
+                {
+                    unsigned char *page = file.data() + sizeof(header) +
+                                          virtualTileIndex(width, height, level, tileX, tileY) * pageBytes;
+                    for (int y = 0; y < virtualPageSize; ++y)
+                    {
+                        int const sy = glm::clamp(int(tileY) * virtualTileSize + y - virtualTileBorder, 0, levelHeight - 1);
+                        for (int x = 0; x < virtualPageSize; ++x)
+                        {
+                            int const sx = glm::clamp(tileX * virtualTileSize + x - virtualTileBorder, 0, levelWidth - 1);
+                            memcpy(page + (size_t(y) * virtualPageSize + x) * 3, texels + (size_t(sy) * levelWidth + sx) * 3, 3);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    file.close();
+    std::rename((path + ".tmp").c_str(), path.c_str());
+    std::cout << source << " -> " << path << ": " << width << "x" << height << ", " << levelCount << " levels, "
+              << tileCount << " tiles of " << virtualTileSize << "x" << virtualTileSize << std::endl;
+    return true;
+}
+
+// compile-time 32-bit FNV-1a of a uniform name, the key ShaderProgram finds locations by
+constexpr uint32_t uniformKey(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name ? uniformKey(name + 1, (hash ^ uint8_t(*name)) * 16777619u) : hash;
+}
+
+// the uniforms draw code sets, hashed once by the compiler
+// modelViewProjection is world, view and projection in one, multiplied on the CPU once per object
+constexpr uint32_t uniformModelViewProjection = uniformKey("modelViewProjection");
+constexpr uint32_t uniformTexture1 = uniformKey("texture1");
+constexpr uint32_t uniformLayer = uniformKey("layer");
+constexpr uint32_t uniformRings = uniformKey("rings");
+constexpr uint32_t uniformSectors = uniformKey("sectors");
+constexpr uint32_t uniformSkybox = uniformKey("skybox");
+constexpr uint32_t uniformIndirection = uniformKey("indirection");
+constexpr uint32_t uniformPages = uniformKey("pages");
+constexpr uint32_t uniformVirtualSize = uniformKey("virtualSize");
+constexpr uint32_t uniformLevelCount = uniformKey("levelCount");
+constexpr uint32_t uniformTileSize = uniformKey("tileSize");
+constexpr uint32_t uniformPageBorder = uniformKey("pageBorder");
+constexpr uint32_t uniformPageCacheTexels = uniformKey("pageCacheTexels");
+constexpr uint32_t uniformLodBias = uniformKey("lodBias");
+
+// out[i] = left * right[i] for column-major 4x4 matrices, in place when out == right
+// each output column is the columns of left weighted by one column of right, four lanes at a time with SSE
+void multiplyMatrices(const mat4 &left, const mat4 *right, mat4 *out, size_t count)
+{
+#if defined(__SSE2__)
+    const float *l = &left[0][0];
+    __m128 const l0 = _mm_loadu_ps(l);
+    __m128 const l1 = _mm_loadu_ps(l + 4);
+    __m128 const l2 = _mm_loadu_ps(l + 8);
+    __m128 const l3 = _mm_loadu_ps(l + 12);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float *r = &right[i][0][0];
+        float *o = &out[i][0][0];
+        for (int column = 0; column < 4; ++column)
+        {
+            const float *c = r + 4 * column;
+            __m128 sum = _mm_mul_ps(l0, _mm_set1_ps(c[0]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(l1, _mm_set1_ps(c[1])));
+            sum = _mm_add_ps(sum, _mm_mul_ps(l2, _mm_set1_ps(c[2])));
+            sum = _mm_add_ps(sum, _mm_mul_ps(l3, _mm_set1_ps(c[3])));
+            _mm_storeu_ps(o + 4 * column, sum);
+        }
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = left * right[i];
+    }
+#endif
+}
+
+mat4 multiplyMatrix(const mat4 &left, const mat4 &right)
+{
+    mat4 result;
+    multiplyMatrices(left, &right, &result, 1);
+    return result;
+}
+
+// the vertex stage of a software rasterizer (transform, perspective divide, viewport) over sphere vertices, once with
+// the per-vertex projection * view * world product the shaders used to do and once with one CPU-side MVP per object
+// then the batch matrix product against plain glm, per matrix
+void benchmarkVertexStage()
+{
+    mat4 const projection = glm::perspective(70.0f, 800.0f / 600.0f, 0.01f, 100.0f);
+    mat4 const view = lookAt(vec3(0.6f, 1.0f, 10.0f), vec3(0.0f, 0.0f, -20.0f), vec3(0.0f, 1.0f, 0.0f));
+    mat4 const world = translate(mat4(1.0f), vec3(5.0f, 0.0f, -20.0f)) * scale(mat4(1.0f), vec3(0.3f));
+    float const halfWidth = 400.0f, halfHeight = 300.0f;
+
+    for (unsigned int tessellation : {40u, 256u, 1024u})
+    {
+        std::vector<PositionUV> vertices;
+        std::vector<unsigned int> indices;
+        generateSphere(tessellation, tessellation, vertices, indices);
+        unsigned int const passes = std::max(1u, 20000000u / unsigned(vertices.size()));
+
+        // screen coordinates are summed so the compiler cannot drop the work
+        auto run = [&](bool perVertexProduct) {
+            double checksum = 0.0;
+            auto const start = std::chrono::steady_clock::now();
+            for (unsigned int pass = 0; pass < passes; ++pass)
+            {
+                mat4 const modelViewProjection = multiplyMatrix(multiplyMatrix(projection, view), world);
+                for (const PositionUV &vertex : vertices)
+                {
+                    vec4 const position(vertex.position, 1.0f);
+                    vec4 const clip = perVertexProduct ? projection * view * world * position : modelViewProjection * position;
+                    checksum += (clip.x / clip.w + 1.0f) * halfWidth + (clip.y / clip.w + 1.0f) * halfHeight;
+                }
+            }
+            double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return std::make_pair(seconds * 1e9 / (double(passes) * vertices.size()), checksum);
+        };
+        auto const perVertex = run(true);
+        auto const perObject = run(false);
+        std::cout << "vertex stage " << tessellation << "x" << tessellation << ": " << perVertex.first
+                  << " ns/vertex with projection * view * world per vertex, " << perObject.first
+                  << " ns/vertex with one MVP per object (" << perVertex.first / perObject.first << "x, checksums "
+                  << perVertex.second << " / " << perObject.second << ")" << std::endl;
+    }
+
+    std::vector<mat4> worlds(4096, world);
+    std::vector<mat4> results(worlds.size());
+    unsigned int const passes = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int pass = 0; pass < passes; ++pass)
+    {
+        for (size_t i = 0; i < worlds.size(); ++i)
+        {
+            results[i] = projection * worlds[i];
+        }
+    }
+    double const glmNs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 /
+                         (double(passes) * worlds.size());
+    float const glmCheck = results.back()[3][3];
+    start = std::chrono::steady_clock::now();
+    for (unsigned int pass = 0; pass < passes; ++pass)
+    {
+        multiplyMatrices(projection, worlds.data(), results.data(), worlds.size());
+    }
+    double const batchNs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 /
+                           (double(passes) * worlds.size());
+    std::cout << "matrix product: " << glmNs << " ns/matrix glm, " << batchNs << " ns/matrix multiplyMatrices (checksums "
+              << glmCheck << " / " << results.back()[3][3] << ")" << std::endl;
+}
+
+// std140 mirror of the FrameData block, written once per frame and bound at frameDataBinding for every program
+// that declares it; only the skybox does, everything else gets its whole MVP as a plain uniform
+struct FrameData
+{
+    mat4 skyboxViewProjection; // view without its translation
+};
+
+const GLuint frameDataBinding = 0;
+
+// bytes handed to glUniform* and to the FrameData buffer, FrameStats shows them per frame
+unsigned long long uniformUploadBytes = 0;
+
+// one write per frame; the old contents are orphaned so the driver never waits on draws still reading them
+void writeFrameData(GLuint buffer, const FrameData &data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(data), &data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    uniformUploadBytes += sizeof(data);
+}
+
+// every glGetUniformLocation goes through here, FrameStats shows how many happen per frame
+std::atomic<unsigned long long> uniformLookupCount(0);
+
+GLint uniformLocation(GLuint program, const char *name)
+{
+    uniformLookupCount++;
+    return glGetUniformLocation(program, name);
+}
+
+// a linked program with the locations of its active uniforms, enumerated once through GL_ACTIVE_UNIFORMS
+// draw code sets uniforms by compile-time key; a key the program does not use resolves to -1, which glUniform*
+// ignores just like the result of a failed glGetUniformLocation
+// a FrameData block is attached to frameDataBinding here, GLSL 330 cannot say so in the shader
+// the setters apply to the program in use, as glUniform* does
+class ShaderProgram
+{
+public:
+    ShaderProgram() = default;
+
+    explicit ShaderProgram(GLuint program) : program(program)
+    {
+        if (!program)
+        {
+            return;
+        }
+        GLuint const frameDataBlock = glGetUniformBlockIndex(program, "FrameData");
+        if (frameDataBlock != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(program, frameDataBlock, frameDataBinding);
+        }
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(program, i, GLsizei(name.size()), &length, &size, &type, name.data());
+            std::string uniform(name.data(), length);
+            GLint const location = uniformLocation(program, uniform.c_str());
+            if (location < 0)
+            {
+                continue; // uniform block members have no location
+            }
+            // arrays are listed as name[0], draw code asks for the plain name
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+            {
+                uniform.resize(uniform.size() - 3);
+            }
+            uniforms.push_back({uniformKey(uniform.c_str()), location});
+        }
+        std::sort(uniforms.begin(), uniforms.end(),
+                  [](const Uniform &a, const Uniform &b) { return a.key < b.key; });
+        for (size_t i = 1; i < uniforms.size(); ++i)
+        {
+            if (uniforms[i].key == uniforms[i - 1].key)
+            {
+                std::cerr << "Two uniforms of program " << program << " hash to the same key, rename one" << std::endl;
+            }
+        }
+    }
+
+    GLuint id() const
+    {
+        return program;
+    }
+
+    void use() const
+    {
+        glUseProgram(program);
+    }
+
+    GLint location(uint32_t key) const
+    {
+        auto it = std::lower_bound(uniforms.begin(), uniforms.end(), key,
+                                   [](const Uniform &uniform, uint32_t key) { return uniform.key < key; });
+        return it != uniforms.end() && it->key == key ? it->location : -1;
+    }
+
+    void set(uint32_t key, int value) const
+    {
+        glUniform1i(location(key), value);
+        uniformUploadBytes += sizeof(value);
+    }
+
+    void set(uint32_t key, float value) const
+    {
+        glUniform1f(location(key), value);
+        uniformUploadBytes += sizeof(value);
+    }
+
+    void set(uint32_t key, const vec2 &value) const
+    {
+        glUniform2f(location(key), value.x, value.y);
+        uniformUploadBytes += sizeof(value);
+    }
+
+    void set(uint32_t key, const vec3 &value) const
+    {
+        glUniform3f(location(key), value.x, value.y, value.z);
+        uniformUploadBytes += sizeof(value);
+    }
+
+    void set(uint32_t key, const mat4 &value) const
+    {
+        glUniformMatrix4fv(location(key), 1, GL_FALSE, &value[0][0]);
+        uniformUploadBytes += sizeof(value);
+    }
+
+private:
+    struct Uniform
+    {
+        uint32_t key;
+        GLint location;
+    };
+
+    GLuint program = 0;
+    std::vector<Uniform> uniforms; // sorted by key
+};
+
+// runtime side of one virtual texture
+// per frame: the earth is drawn into the small feedback target with the feedback program, whose pixels name the
+// tile they need; update() reads the previous frame's feedback back, streams missing tiles into least recently
+// used pages (coarse levels first, a few per frame) and refreshes the indirection texture
+class VirtualTexture
+{
+public:
+    // pageCacheSide pages across and down, the only storage that is independent of the source size
+    bool open(const std::string &source, int pageCacheSide)
+    {
+        std::string const path = virtualTexturePath(source);
+        std::error_code error;
+        auto const fileTime = std::filesystem::last_write_time(path, error);
+        if (error || fileTime < std::filesystem::last_write_time(source, error) || !file.openRead(path) ||
+            file.size() < sizeof(header))
+        {
+            std::cerr << "No current virtual texture for " << source << ", build it with --build-virtual-texture "
+                      << source << std::endl;
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        size_t const tileCount = virtualTileIndex(header.width, header.height, header.levelCount, 0, 0);
+        if (memcmp(header.magic, "C371VTX", 8) != 0 || header.version != virtualTextureVersion ||
+            header.tileSize != uint32_t(virtualTileSize) || header.border != uint32_t(virtualTileBorder) ||
+            file.size() != sizeof(header) + tileCount * pageBytes())
+        {
+            std::cerr << "Ignoring stale virtual texture " << path << std::endl;
+            file.close();
+            return false;
+        }
+
+        cacheSide = pageCacheSide;
+        pages.assign(cacheSide * cacheSide, Page());
+
+        glGenTextures(1, &pageTexture);
+        glBindTexture(GL_TEXTURE_2D, pageTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, cacheSide * virtualPageSize, cacheSide * virtualPageSize, 0, GL_RGB,
+                     GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // one RGBA8 texel per tile: page x, page y, level of the tile actually mapped, 255 once valid
+        // allocated once with every tile invalid, after that only the entries a streamed tile changes are uploaded
+        indirection.resize(header.levelCount);
+        glGenTextures(1, &indirectionTexture);
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        for (int level = 0; level < int(header.levelCount); ++level)
+        {
+            int const tilesX = virtualTilesX(header.width, level);
+            int const tilesY = virtualTilesY(header.height, level);
+            indirection[level].assign(size_t(tilesX) * tilesY * 4, 0);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, tilesX, tilesY, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         indirection[level].data());
+        }
+
+        // the coarsest level is pinned, every lookup can fall back to it
+        int const last = header.levelCount - 1;
+        for (int y = 0; y < virtualTilesY(header.height, last); ++y)
+        {
+            for (int x = 0; x < virtualTilesX(header.width, last); ++x)
+            {
+                streamTile(tileKey(last, x, y), true);
+            }
+        }
+        updateIndirection();
+
+        std::cout << "virtual texture " << source << ": " << header.width << "x" << header.height << ", "
+                  << header.levelCount << " levels, " << tileCount << " tiles on disk, page cache " << cacheSide << "x"
+                  << cacheSide << " pages (" << size_t(cacheSide * virtualPageSize) * cacheSide * virtualPageSize * 4 / 1024
+                  << " KB)" << std::endl;
+        return true;
+    }
+
+    ~VirtualTexture()
+    {
+        release();
+    }
+
+    // GL objects go before the context does
+    void release()
+    {
+        if (!pageTexture && !feedbackFramebuffer)
+        {
+            return;
+        }
+        glDeleteTextures(1, &pageTexture);
+        glDeleteTextures(1, &indirectionTexture);
+        glDeleteBuffers(2, feedbackBuffers);
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+        glDeleteRenderbuffers(2, feedbackRenderbuffers);
+        pageTexture = indirectionTexture = feedbackFramebuffer = 0;
+        feedbackBuffers[0] = feedbackBuffers[1] = feedbackRenderbuffers[0] = feedbackRenderbuffers[1] = 0;
+    }
+
+    bool isOpen() const
+    {
+        return pageTexture != 0;
+    }
 
-    float const R = 1.0f / float(rings - 1);
-    float const S = 1.0f / float(sectors - 1);
+    // sampling uniforms, shared by the virtual and the feedback program
+    void bind(const ShaderProgram &program) const
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, pageTexture);
+        glActiveTexture(GL_TEXTURE0);
+        program.set(uniformIndirection, 1);
+        program.set(uniformPages, 2);
+        program.set(uniformVirtualSize, vec2(header.width, header.height));
+        program.set(uniformLevelCount, int(header.levelCount));
+        program.set(uniformTileSize, float(virtualTileSize));
+        program.set(uniformPageBorder, float(virtualTileBorder));
+        program.set(uniformPageCacheTexels, float(cacheSide * virtualPageSize));
+    }
 
-    for (unsigned int r = 0; r < rings; ++r)
+    // binds the feedback target, sized to 1/feedbackScale of the framebuffer and cleared to "no tile"
+    void beginFeedback(int framebufferWidth, int framebufferHeight, const ShaderProgram &program)
     {
-        for (unsigned int s = 0; s < sectors; ++s)
+        int const width = std::max(1, framebufferWidth / feedbackScale);
+        int const height = std::max(1, framebufferHeight / feedbackScale);
+        if (width != feedbackWidth || height != feedbackHeight)
         {
-            float const y = sin(-glm::half_pi<float>() + glm::pi<float>() * r * R);
-            float const x = cos(2 * glm::pi<float>() * s * S) * sin(glm::pi<float>() * r * R);
-            float const z = sin(2 * glm::pi<float>() * s * S) * sin(glm::pi<float>() * r * R);
-            vertices.push_back(vec3(x, y, z));
-            uvs.push_back(vec2(s * S, r * R));
+            resizeFeedback(width, height);
         }
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        program.use();
+        bind(program);
+        // derivatives are feedbackScale times coarser here than on screen
+        program.set(uniformLodBias, -std::log2(float(feedbackScale)));
     }
-    for (unsigned int r = 0; r < rings - 1; ++r)
+
+    // starts the asynchronous readback of this frame's feedback, picked up by next frame's update()
+    void endFeedback()
     {
-        for (unsigned int s = 0; s < sectors - 1; ++s)
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[frame % 2]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        feedbackPending[frame % 2] = true;
+    }
+
+    // once per frame on the GL thread, after endFeedback()
+    void update()
+    {
+        frame++;
+        unsigned int const slot = frame % 2;
+        if (!feedbackPending[slot])
+        {
+            return;
+        }
+        feedbackPending[slot] = false;
+
+        // every visible tile plus its ancestors, so coarser detail arrives first and is kept warm
+        std::set<uint64_t> wanted;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[slot]);
+        const unsigned char *texels = (const unsigned char *)glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, size_t(feedbackWidth) * feedbackHeight * 4, GL_MAP_READ_BIT);
+        for (size_t i = 0; texels && i < size_t(feedbackWidth) * feedbackHeight; ++i)
+        {
+            const unsigned char *texel = texels + i * 4;
+            if (texel[3] == 0)
+            {
+                continue;
+            }
+            int level = texel[2] & 15;
+            int x = texel[0] | ((texel[2] >> 4) & 3) << 8;
+            int y = texel[1] | (texel[2] >> 6) << 8;
+            for (; level < int(header.levelCount); ++level, x /= 2, y /= 2)
+            {
+                x = std::min(x, virtualTilesX(header.width, level) - 1);
+                y = std::min(y, virtualTilesY(header.height, level) - 1);
+                if (!wanted.insert(tileKey(level, x, y)).second)
+                {
+                    break;
+                }
+            }
+        }
+        if (texels)
+        {
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::vector<uint64_t> missing;
+        for (uint64_t key : wanted)
         {
-            indices.push_back(r * sectors + s);
-            indices.push_back(r * sectors + (s + 1));
-            indices.push_back((r + 1) * sectors + (s + 1));
+            auto const resident = residentPages.find(key);
+            if (resident != residentPages.end())
+            {
+                pages[resident->second].lastUsedFrame = frame;
+            }
+            else
+            {
+                missing.push_back(key);
+            }
+        }
 
-            indices.push_back(r * sectors + s);
-            indices.push_back((r + 1) * sectors + (s + 1));
-            indices.push_back((r + 1) * sectors + s);
+        // coarsest first, the level sits in the top bits of the key
+        std::sort(missing.begin(), missing.end(), std::greater<uint64_t>());
+        unsigned int streamed = 0;
+        for (uint64_t key : missing)
+        {
+            if (streamed == tilesPerFrame || !streamTile(key, false))
+            {
+                break;
+            }
+            streamed++;
+        }
+        if (streamed > 0)
+        {
+            updateIndirection();
+            streamedTiles += streamed;
         }
     }
 
-    GLuint vao, vbo[2], ebo;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    void printStats() const
+    {
+        std::cout << "virtual texture: " << residentPages.size() << "/" << pages.size() << " pages resident, "
+                  << streamedTiles << " tiles streamed, " << evictedTiles << " evicted" << std::endl;
+    }
 
-    glGenBuffers(2, vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    glEnableVertexAttribArray(0);
+private:
+    struct Page
+    {
+        uint64_t key = 0;
+        bool used = false;
+        bool pinned = false;
+        unsigned long long lastUsedFrame = 0;
+    };
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(vec2), &uvs[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    glEnableVertexAttribArray(1);
+    static const int feedbackScale = 8;
+    static const unsigned int tilesPerFrame = 16;
 
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    static uint64_t tileKey(int level, int x, int y)
+    {
+        return (uint64_t(level) << 40) | (uint64_t(y) << 20) | uint64_t(x);
+    }
 
-    indexCount = indices.size();
-    return vao;
-}
+    size_t pageBytes() const
+    {
+        return size_t(virtualPageSize) * virtualPageSize * 3;
+    }
 
-GLuint loadTexture(const char *path)
-{
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        stbi_image_free(data);
+    // copies one tile from the mapped file into a free or least recently used page
+    // false when every page is pinned or was needed this frame
+    bool streamTile(uint64_t key, bool pin)
+    {
+        int best = -1;
+        for (int i = 0; i < int(pages.size()); ++i)
+        {
+            if (!pages[i].used)
+            {
+                best = i;
+                break;
+            }
+            if (!pages[i].pinned && pages[i].lastUsedFrame < frame &&
+                (best < 0 || pages[i].lastUsedFrame < pages[best].lastUsedFrame))
+            {
+                best = i;
+            }
+        }
+        if (best < 0)
+        {
+            return false;
+        }
+
+        Page &page = pages[best];
+        if (page.used)
+        {
+            residentPages.erase(page.key);
+            changedTiles.push_back(page.key);
+            evictedTiles++;
+        }
+        changedTiles.push_back(key);
+        page.key = key;
+        page.used = true;
+        page.pinned = pin;
+        page.lastUsedFrame = frame;
+        residentPages[key] = best;
+
+        int const level = int(key >> 40);
+        int const y = int((key >> 20) & 0xFFFFF);
+        int const x = int(key & 0xFFFFF);
+        const unsigned char *tile =
+            file.data() + sizeof(header) + virtualTileIndex(header.width, header.height, level, x, y) * pageBytes();
+        glBindTexture(GL_TEXTURE_2D, pageTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (best % cacheSide) * virtualPageSize, (best / cacheSide) * virtualPageSize,
+                        virtualPageSize, virtualPageSize, GL_RGB, GL_UNSIGNED_BYTE, tile);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return true;
     }
-    else
+
+    // every tile points at its own page when resident, otherwise inherits its parent's entry
+    void updateEntry(int level, int x, int y)
     {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-        stbi_image_free(data);
+        unsigned char *entry = &indirection[level][(size_t(y) * virtualTilesX(header.width, level) + x) * 4];
+        auto const resident = residentPages.find(tileKey(level, x, y));
+        if (resident != residentPages.end())
+        {
+            entry[0] = resident->second % cacheSide;
+            entry[1] = resident->second / cacheSide;
+            entry[2] = level;
+            entry[3] = 255;
+        }
+        else if (level + 1 < int(header.levelCount))
+        {
+            int const parentX = std::min(x / 2, virtualTilesX(header.width, level + 1) - 1);
+            int const parentY = std::min(y / 2, virtualTilesY(header.height, level + 1) - 1);
+            memcpy(entry, &indirection[level + 1][(size_t(parentY) * virtualTilesX(header.width, level + 1) + parentX) * 4], 4);
+        }
+        else
+        {
+            memset(entry, 0, 4);
+        }
+    }
+
+    // entries of the tiles streamed in or evicted since the last call, and of the finer tiles inheriting from them
+    // coarsest first so children see their parent's new entry, each level's changed rectangle uploaded on its own
+    void updateIndirection()
+    {
+        std::sort(changedTiles.begin(), changedTiles.end(), std::greater<uint64_t>());
+        changedTiles.erase(std::unique(changedTiles.begin(), changedTiles.end()), changedTiles.end());
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        for (uint64_t key : changedTiles)
+        {
+            int const changedLevel = int(key >> 40);
+            int x0 = int(key & 0xFFFFF), y0 = int((key >> 20) & 0xFFFFF);
+            int x1 = x0 + 1, y1 = y0 + 1;
+            for (int level = changedLevel; level >= 0; --level)
+            {
+                int const tilesX = virtualTilesX(header.width, level);
+                int const tilesY = virtualTilesY(header.height, level);
+                if (level < changedLevel)
+                {
+                    // the last row and column of a level also parent whatever the clamp in updateEntry sends them
+                    x1 = x1 == virtualTilesX(header.width, level + 1) ? tilesX : std::min(x1 * 2, tilesX);
+                    y1 = y1 == virtualTilesY(header.height, level + 1) ? tilesY : std::min(y1 * 2, tilesY);
+                    x0 = std::min(x0 * 2, x1);
+                    y0 = std::min(y0 * 2, y1);
+                }
+                if (x0 == x1 || y0 == y1)
+                {
+                    break;
+                }
+                for (int y = y0; y < y1; ++y)
+                {
+                    for (int x = x0; x < x1; ++x)
+                    {
+                        updateEntry(level, x, y);
+                    }
+                }
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, tilesX);
+                glTexSubImage2D(GL_TEXTURE_2D, level, x0, y0, x1 - x0, y1 - y0, GL_RGBA, GL_UNSIGNED_BYTE,
+                                &indirection[level][(size_t(y0) * tilesX + x0) * 4]);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        changedTiles.clear();
+    }
+
+    void resizeFeedback(int width, int height)
+    {
+        if (!feedbackFramebuffer)
+        {
+            glGenFramebuffers(1, &feedbackFramebuffer);
+            glGenRenderbuffers(2, feedbackRenderbuffers);
+            glGenBuffers(2, feedbackBuffers);
+        }
+        feedbackWidth = width;
+        feedbackHeight = height;
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackRenderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackRenderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackRenderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackRenderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Virtual texture feedback target is incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        for (GLuint buffer : feedbackBuffers)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size_t(width) * height * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackPending[0] = feedbackPending[1] = false;
     }
-    return textureID;
-}
+
+    MappedFile file;
+    VirtualTextureHeader header = {};
+    int cacheSide = 0;
+    std::vector<Page> pages;
+    std::map<uint64_t, int> residentPages;
+    std::vector<std::vector<unsigned char>> indirection; // CPU copy of every indirection level
+    std::vector<uint64_t> changedTiles;                  // since the last updateIndirection
+    GLuint pageTexture = 0;
+    GLuint indirectionTexture = 0;
+    GLuint feedbackFramebuffer = 0;
+    GLuint feedbackRenderbuffers[2] = {0, 0}; // colour, depth
+    GLuint feedbackBuffers[2] = {0, 0};       // pixel-pack buffers, read back one frame late
+    bool feedbackPending[2] = {false, false};
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    GLint savedViewport[4] = {0, 0, 0, 0};
+    unsigned long long frame = 1;
+    unsigned int streamedTiles = 0;
+    unsigned int evictedTiles = 0;
+};
 
 std::string readFile(const char *filePath)
 {
@@ -119,11 +4248,31 @@ std::string getTexturedSphereVertexShaderSource()
     return readFile("shaders/textured_sphere.vert.glsl");
 }
 
+std::string getProceduralSphereVertexShaderSource()
+{
+    return readFile("shaders/textured_sphere_procedural.vert.glsl");
+}
+
 std::string getTexturedSphereFragmentShaderSource()
 {
     return readFile("shaders/textured_sphere.frag.glsl");
 }
 
+std::string getTexturedSphereArrayFragmentShaderSource()
+{
+    return readFile("shaders/textured_sphere_array.frag.glsl");
+}
+
+std::string getTexturedSphereVirtualFragmentShaderSource()
+{
+    return readFile("shaders/textured_sphere_virtual.frag.glsl");
+}
+
+std::string getVirtualTextureFeedbackFragmentShaderSource()
+{
+    return readFile("shaders/virtual_texture_feedback.frag.glsl");
+}
+
 std::string getVertexShaderSource()
 {
     return readFile("shaders/shader.vert.glsl");
@@ -144,88 +4293,563 @@ std::string getSkyboxFragmentShaderSource()
     return readFile("shaders/skybox_fragment.glsl");
 }
 
-GLuint compileTexturedSphereShader()
+// driver messages for a shader or program, empty when there are none
+std::string shaderInfoLog(GLuint shader)
+{
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+    return log.c_str();
+}
+
+std::string programInfoLog(GLuint program)
 {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    std::string vsSourceStr = getTexturedSphereVertexShaderSource();
-    const char *vsSource = vsSourceStr.c_str();
-    glShaderSource(vs, 1, &vsSource, nullptr);
-    glCompileShader(vs);
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    glGetProgramInfoLog(program, length, nullptr, &log[0]);
+    return log.c_str();
+}
+
+// one stage compiled from source, 0 with the driver's log on failure; stage is VERTEX or FRAGMENT
+GLuint compileShaderStage(GLenum type, const std::string &source, const char *stage, const std::string &label)
+{
+    GLuint shader = glCreateShader(type);
+    const char *text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        std::cerr << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED (" << label << ")\n"
+                  << shaderInfoLog(shader) << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
 
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    std::string fsSourceStr = getTexturedSphereFragmentShaderSource();
-    const char *fsSource = fsSourceStr.c_str();
-    glShaderSource(fs, 1, &fsSource, nullptr);
-    glCompileShader(fs);
+// vertex and fragment source linked into a program, 0 with the driver's logs on failure
+// retrievable asks the driver to keep the binary around for glGetProgramBinary
+GLuint compileProgram(const std::string &vertexSource, const std::string &fragmentSource, const std::string &label,
+                      bool retrievable = false)
+{
+    GLuint vertexShader = compileShaderStage(GL_VERTEX_SHADER, vertexSource, "VERTEX", label);
+    GLuint fragmentShader = compileShaderStage(GL_FRAGMENT_SHADER, fragmentSource, "FRAGMENT", label);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
 
     GLuint program = glCreateProgram();
-    glAttachShader(program, vs);
-    glAttachShader(program, fs);
+    if (retrievable)
+    {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
     glLinkProgram(program);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED (" << label << ")\n" << programInfoLog(program) << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
     return program;
 }
 
-int compileVertexAndFragShaders()
+// linked programs keyed by their sources, stored on disk as driver binaries and loaded with glProgramBinary
+// the key also covers the GL vendor, renderer and version strings, so a driver update looks up a new entry instead
+// of loading a binary it may reject; a binary the driver rejects anyway is deleted and the program compiled again
+class ProgramCache
 {
-    // compile and link shader program
-    // return shader program id
-    // ------------------------------------
+public:
+    // needs a current context, an empty directory compiles every program from source
+    explicit ProgramCache(const std::string &cacheDirectory = "") : cacheDirectory(cacheDirectory)
+    {
+        GLint formatCount = 0;
+        if (GLEW_ARB_get_program_binary)
+        {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        }
+        std::error_code error;
+        if (this->cacheDirectory.empty())
+        {
+            return;
+        }
+        if (formatCount == 0)
+        {
+            std::cerr << "Program cache disabled, the driver cannot return program binaries" << std::endl;
+            this->cacheDirectory.clear();
+        }
+        else if (!std::filesystem::create_directories(cacheDirectory, error) && error)
+        {
+            std::cerr << "Program cache disabled, cannot create " << cacheDirectory << ": " << error.message() << std::endl;
+            this->cacheDirectory.clear();
+        }
 
-    // vertex shader
-    int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    std::string vertexShaderSourceStr = getVertexShaderSource();
-    const char *vertexShaderSource = vertexShaderSourceStr.c_str();
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const GLubyte *value = glGetString(name);
+            driver += value ? (const char *)value : "";
+            driver += '\n';
+        }
+    }
+
+    ProgramCache(const ProgramCache &) = delete;
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    // linked program from the cache or compiled from source, 0 with the driver's log on failure
+    // label names the program in error messages
+    GLuint build(const std::string &vertexSource, const std::string &fragmentSource, const std::string &label)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        std::string const path = cacheDirectory.empty() ? "" : cachePath(vertexSource, fragmentSource);
+        GLuint program = path.empty() ? 0 : loadBinary(path);
+        if (program)
+        {
+            binaryCount++;
+            binaryMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return program;
+        }
+
+        program = compileProgram(vertexSource, fragmentSource, label, !path.empty());
+        if (program && !path.empty() && !storeBinary(program, path))
+        {
+            std::cerr << "Failed to write program cache " << path << std::endl;
+        }
+        compiledCount++;
+        compiledMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return program;
+    }
+
+    // warm (from binaries) and cold (from source) cost so far, reported separately
+    std::string summary() const
+    {
+        std::ostringstream text;
+        text << binaryCount << " loaded from binaries in " << binaryMs << " ms, " << compiledCount
+             << " compiled from source in " << compiledMs << " ms";
+        if (rejectedCount > 0)
+        {
+            text << ", " << rejectedCount << " binaries rejected";
+        }
+        return text.str();
+    }
+
+private:
+    // bump when the file layout changes, driver changes are covered by the key
+    static const uint32_t version = 1;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t binaryFormat;
+        uint64_t binarySize;
+    };
+
+    std::string cachePath(const std::string &vertexSource, const std::string &fragmentSource) const
+    {
+        uint64_t hash = hashBytes(driver.data(), driver.size());
+        hash = hashBytes(vertexSource.data(), vertexSource.size() + 1, hash);
+        hash = hashBytes(fragmentSource.data(), fragmentSource.size(), hash);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+        return cacheDirectory + "/" + name;
+    }
+
+    GLuint loadBinary(const std::string &path)
+    {
+        MappedFile file;
+        Header header;
+        if (!file.openRead(path) || file.size() < sizeof(header))
+        {
+            return 0;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, "C371PRG", 8) != 0 || header.version != version ||
+            file.size() != sizeof(header) + header.binarySize)
+        {
+            std::cerr << "Ignoring stale program cache " << path << std::endl;
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), GLsizei(header.binarySize));
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            std::cerr << "Program binary " << path << " rejected by the driver, compiling from source" << std::endl;
+            glDeleteProgram(program);
+            file.close();
+            std::remove(path.c_str());
+            rejectedCount++;
+            return 0;
+        }
+        return program;
+    }
+
+    // written under a temporary name and renamed, like the mesh cache
+    bool storeBinary(GLuint program, const std::string &path)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+        {
+            return false;
+        }
+
+        MappedFile file;
+        if (!file.create(path + ".tmp", sizeof(Header) + length))
+        {
+            return false;
+        }
+        Header header = {{'C', '3', '7', '1', 'P', 'R', 'G', '\0'}, version, 0, 0};
+        GLsizei written = 0;
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &written, &format, file.data() + sizeof(header));
+        header.binaryFormat = format;
+        header.binarySize = written;
+        memcpy(file.data(), &header, sizeof(header));
+        file.close();
+        if (written != length)
+        {
+            std::remove((path + ".tmp").c_str());
+            return false;
+        }
+        return std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    }
+
+    std::string cacheDirectory;
+    std::string driver; // vendor, renderer and version, part of every key
+    unsigned int binaryCount = 0;
+    unsigned int compiledCount = 0;
+    unsigned int rejectedCount = 0;
+    double binaryMs = 0.0;
+    double compiledMs = 0.0;
+};
+
+// textured sphere program, the vertex stage is either the buffered or the procedural one
+// and the fragment stage samples either a 2D texture or a layer of the body texture array
+GLuint compileTexturedSphereShader(ProgramCache &programs, const std::string &vsSourceStr, const std::string &fsSourceStr)
+{
+    return programs.build(vsSourceStr, fsSourceStr, "textured sphere");
+}
+
+// rebuilds programs whose shader files change under a directory, while the app keeps running
+// a thread with its own hidden context (sharing objects with the main one) waits on inotify, recompiles every
+// program that uses a changed file and hands back the ones that linked; applyReloads() swaps them in between frames,
+// so the render loop only ever sees complete programs and a failed edit keeps the running one
+// compile and link logs go to std::cerr as on startup
+class ShaderWatcher
+{
+public:
+    ShaderWatcher(GLFWwindow *context, const std::string &directory) : context(context), directory(directory)
+    {
+    }
+
+    ShaderWatcher(const ShaderWatcher &) = delete;
+    ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+    ~ShaderWatcher()
+    {
+        stopping = true;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    // every program to rebuild, registered before start(); program must outlive the watcher
+    void watch(ShaderProgram &program, const std::string &vertexPath, const std::string &fragmentPath,
+               const std::string &label)
+    {
+        entries.push_back({&program, vertexPath, fragmentPath, label});
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        thread = std::thread([this] { run(); });
+        std::cout << "watching " << directory << "/ for shader changes, " << entries.size() << " programs" << std::endl;
+#else
+        std::cerr << "Shader hot reload needs inotify, " << directory << "/ is not watched" << std::endl;
+#endif
+    }
+
+    // on the GL thread between frames: rebuilt programs replace the live ones, the old ones are deleted
+    unsigned int applyReloads()
+    {
+        std::vector<Reload> reloads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reloads.swap(ready);
+        }
+        for (Reload &reload : reloads)
+        {
+            glDeleteProgram(reload.program->id());
+            *reload.program = std::move(reload.replacement);
+        }
+        return reloads.size();
+    }
+
+private:
+    struct Entry
+    {
+        ShaderProgram *program;
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::string label;
+    };
+
+    struct Reload
+    {
+        ShaderProgram *program;
+        ShaderProgram replacement;
+    };
+
+    // editors write a file in several steps, events closer together than this are one change
+    static const int settleMs = 50;
+
+#ifdef __linux__
+    void run()
+    {
+        int const fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            std::cerr << "Failed to watch " << directory << "/ for shader changes" << std::endl;
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            return;
+        }
+        glfwMakeContextCurrent(context);
+
+        while (!stopping)
+        {
+            pollfd waiting = {fd, POLLIN, 0};
+            if (poll(&waiting, 1, 200) <= 0)
+            {
+                continue;
+            }
+            std::set<std::string> changed;
+            while (readEvents(fd, changed))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+            }
+            rebuild(changed);
+        }
+
+        glfwMakeContextCurrent(nullptr);
+        ::close(fd);
+    }
+
+    // names of files written since the last call, false once nothing was pending
+    static bool readEvents(int fd, std::set<std::string> &changed)
+    {
+        alignas(inotify_event) char buffer[4096];
+        bool any = false;
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *at = buffer; at < buffer + length;)
+            {
+                const inotify_event *event = (const inotify_event *)at;
+                if (event->len > 0)
+                {
+                    changed.insert(event->name);
+                }
+                at += sizeof(inotify_event) + event->len;
+            }
+            any = true;
+        }
+        return any;
+    }
+
+    void rebuild(const std::set<std::string> &changed)
+    {
+        std::vector<Reload> built;
+        for (const Entry &entry : entries)
+        {
+            if (!changed.count(std::filesystem::path(entry.vertexPath).filename().string()) &&
+                !changed.count(std::filesystem::path(entry.fragmentPath).filename().string()))
+            {
+                continue;
+            }
+            auto const start = std::chrono::steady_clock::now();
+            GLuint const program =
+                compileProgram(readFile(entry.vertexPath.c_str()), readFile(entry.fragmentPath.c_str()), entry.label);
+            if (!program)
+            {
+                std::cerr << "shader reload: " << entry.label << " failed, keeping the running program" << std::endl;
+                continue;
+            }
+            built.push_back({entry.program, ShaderProgram(program)});
+            std::cout << "shader reload: " << entry.label << " rebuilt in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                      << " ms" << std::endl;
+        }
+        if (built.empty())
+        {
+            return;
+        }
+
+        // the programs must be complete before the main context can use them
+        glFinish();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Reload &reload : built)
+        {
+            ready.push_back(std::move(reload));
+        }
+    }
+#endif
+
+    GLFWwindow *context;
+    std::string directory;
+    std::vector<Entry> entries;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::vector<Reload> ready; // guarded by mutex
+};
+
+// draws a rings x sectors sphere without vertex or index buffers, the procedural program rebuilds it from gl_VertexID
+// core profile still needs some VAO bound, emptyVAO has no attributes
+void drawProceduralSphere(const ShaderProgram &program, GLuint emptyVAO, unsigned int rings, unsigned int sectors)
+{
+    program.set(uniformRings, int(rings));
+    program.set(uniformSectors, int(sectors));
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, (rings - 1) * (sectors - 1) * 6);
+}
+
+// wall time of each startup phase, printed once before the first frame
+class StartupTimer
+{
+public:
+    StartupTimer() : start(std::chrono::steady_clock::now()), last(start)
+    {
+    }
+
+    // ends the current phase under the given name
+    void mark(const std::string &phase, const std::string &detail = "")
+    {
+        auto const now = std::chrono::steady_clock::now();
+        phases.push_back({phase + (detail.empty() ? "" : " (" + detail + ")"), milliseconds(last, now)});
+        last = now;
+    }
+
+    void print() const
+    {
+        std::cout << "startup:" << std::endl;
+        for (const auto &phase : phases)
+        {
+            std::cout << "  " << phase.first << ": " << phase.second << " ms" << std::endl;
+        }
+        std::cout << "  total: " << milliseconds(start, last) << " ms" << std::endl;
+    }
+
+private:
+    static double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last;
+    std::vector<std::pair<std::string, double>> phases;
+};
+
+// frame time averaged over a couple of seconds, printed to the console with --stats
+struct FrameStats
+{
+    double intervalStart = 0.0;
+    unsigned int frames = 0;
+    unsigned long long triangles = 0;         // sphere triangles drawn during the interval
+    unsigned long long baselineTriangles = 0; // what fixed 40x40 spheres would have drawn
+    unsigned int textureBinds = 0;
+    unsigned long long uniformLookupsAtStart = 0; // uniformLookupCount when the interval began
+    unsigned long long uniformBytesAtStart = 0;   // uniformUploadBytes when the interval began
+
+    void endFrame(double now, const std::string &label)
     {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        frames++;
+        if (now - intervalStart >= 2.0)
+        {
+            std::cout << label << ": " << (now - intervalStart) * 1000.0 / frames << " ms/frame, " << triangles / frames
+                      << " sphere triangles/frame (" << baselineTriangles / frames << " at fixed 40x40), "
+                      << double(textureBinds) / frames << " body texture binds/frame, "
+                      << double(uniformLookupCount - uniformLookupsAtStart) / frames << " uniform name lookups/frame, "
+                      << (uniformUploadBytes - uniformBytesAtStart) / frames << " uniform bytes/frame over " << frames
+                      << " frames" << std::endl;
+            intervalStart = now;
+            uniformLookupsAtStart = uniformLookupCount;
+            uniformBytesAtStart = uniformUploadBytes;
+            textureBinds = 0;
+            frames = 0;
+            triangles = 0;
+            baselineTriangles = 0;
+        }
     }
-
-    // fragment shader
-    int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    std::string fragmentShaderSourceStr = getFragmentShaderSource();
-    const char *fragmentShaderSource = fragmentShaderSourceStr.c_str();
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    // check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+};
+
+// binds what a body samples and returns the program to draw it with
+// a body with a layer only selects it in the array program, the body array is already bound; any other body binds
+// its own 2D texture, counted in textureBinds
+const ShaderProgram &bindBodyTexture(TextureManager &textures, const TextureHandle &texture, int layer,
+                                     const ShaderProgram &program2D, const ShaderProgram &programArray,
+                                     unsigned int &textureBinds)
+{
+    if (layer >= 0)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        programArray.use();
+        programArray.set(uniformLayer, layer);
+        return programArray;
     }
+    program2D.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textures.use(*texture));
+    textureBinds++;
+    return program2D;
+}
 
-    // link shaders
-    int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
+// draws a body with the LOD level its projected size calls for, from its mesh or procedurally
+// procedural drawing reads the tessellation as rings/sectors, so it needs a UV sphere chain
+// returns the number of triangles drawn
+unsigned int drawBodySphere(const LODChain &chain, float projectedRadius, float maxPixelError, bool procedural,
+                            const ShaderProgram &program, GLuint emptyVAO)
+{
+    const LODLevel &level = chain.select(projectedRadius, maxPixelError);
+    if (procedural)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        drawProceduralSphere(program, emptyVAO, level.tessellation, level.tessellation);
+        return (level.tessellation - 1) * (level.tessellation - 1) * 2;
     }
+    drawMesh(*level.mesh);
+    return level.mesh->triangleCount;
+}
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    return shaderProgram;
+int compileVertexAndFragShaders(ProgramCache &programs)
+{
+    // compile and link shader program
+    // return shader program id
+    // ------------------------------------
+    return programs.build(getVertexShaderSource(), getFragmentShaderSource(), "base");
 }
 
-int createVertexBufferObject()
+int createVertexBufferObject(bool quantized)
 {
     // cube model
     vec3 vertexArray[] = {
@@ -277,62 +4901,197 @@ int createVertexBufferObject()
     GLuint vertexBufferObject;
     glGenBuffers(1, &vertexBufferObject);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexArray), vertexArray, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(
-		0, 
-		3, 
-		GL_FLOAT, 
-		GL_FALSE, \
-		2 * sizeof(vec3), 
-		(void *)0);
-    glEnableVertexAttribArray(0);
-
 
-    glVertexAttribPointer(1,
-		3, 
-		GL_FLOAT, 
-		GL_FALSE, 
-		2 * sizeof(vec3), 
-		(void *)sizeof(vec3)
-    );
-    glEnableVertexAttribArray(1);
+    if (quantized)
+    {
+        size_t const vertexCount = sizeof(vertexArray) / (2 * sizeof(vec3));
+        std::vector<PackedPositionColor> packed(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            packed[i] = PackedPositionColor::pack(vertexArray[2 * i], vertexArray[2 * i + 1]);
+        }
+        glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedPositionColor), packed.data(), GL_STATIC_DRAW);
+        applyVertexFormat(PackedPositionColor::format());
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertexArray), vertexArray, GL_STATIC_DRAW);
+        applyVertexFormat(PositionColor::format());
+    }
 
 
     return vertexBufferObject;
 }
 
-unsigned int loadCubemap(std::vector<std::string> faces)
+// immutable storage for levelCount levels of a square cubemap, faces then levels left to glTexSubImage2D
+// without ARB_texture_storage (the context is 3.2) every face and level is allocated mutable with the same sized format
+void allocateCubemapStorage(GLenum internalFormat, int side, int levelCount)
+{
+    if (GLEW_ARB_texture_storage)
+    {
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, levelCount, internalFormat, side, side);
+        return;
+    }
+    for (int face = 0; face < 6; ++face)
+    {
+        for (int level = 0; level < levelCount; ++level)
+        {
+            int const levelSide = std::max(1, side >> level);
+            if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+            {
+                glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internalFormat, levelSide, levelSide,
+                                       0, bc1LevelSize(levelSide, levelSide), nullptr);
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internalFormat, levelSide, levelSide, 0, GL_RGB,
+                             GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+}
+
+// six square faces of one size with full mip chains, sampled seamlessly across face edges
+// maxSide caps the resolution (0 for none): the top levels of larger faces are simply not uploaded
+// BC1 storage when every face has a current compiled container and the driver has S3TC, RGB8 decoded on the pool otherwise
+unsigned int loadCubemap(std::vector<std::string> faces, int maxSide)
 { //SKY!
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    auto const start = std::chrono::steady_clock::now();
 
-    int width, height, nrChannels;
+    // size of the cube from the containers or the image headers, before anything is decoded
+    std::vector<MappedFile> containers(faces.size());
+    std::vector<std::vector<TextureContainerLevel>> containerLevels(faces.size());
+    bool compiled = GLEW_EXT_texture_compression_s3tc;
+    int side = 0;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(
-				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-				0, 
-				GL_RGB, 
-				width, 
-				height, 
-				0, 
-				GL_RGB, 
-				GL_UNSIGNED_BYTE, 
-				data);
+        TextureContainerHeader header;
+        compiled = compiled && openTextureContainer(faces[i], containers[i], header, containerLevels[i]) &&
+                   header.width == header.height;
+        int width = 0, height = 0, channels;
+        if (compiled)
+        {
+            width = header.width;
+            height = header.height;
+        }
+        else if (!stbi_info(faces[i].c_str(), &width, &height, &channels))
+        {
+            std::cerr << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+            return textureID;
+        }
+        if (width != height || (side != 0 && width != side))
+        {
+            std::cerr << "Cubemap faces must be square and of one size: " << faces[i] << " is " << width << "x"
+                      << height << std::endl;
+            return textureID;
+        }
+        side = width;
+    }
+
+    int const levelCount = mipLevelCount(side, side);
+    int skippedLevels = 0;
+    while (maxSide > 0 && skippedLevels + 1 < levelCount && side >> skippedLevels > maxSide)
+    {
+        skippedLevels++;
+    }
+    int const storedSide = std::max(1, side >> skippedLevels);
+    GLenum const internalFormat = compiled ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB8;
+    allocateCubemapStorage(internalFormat, storedSide, levelCount - skippedLevels);
+
+    // the rest decode and build their mip chains concurrently on the pool and are uploaded here in face order, each
+    // as soon as it is ready
+    struct DecodedFace
+    {
+        std::vector<unsigned char> chain; // empty when decoding failed
+        double decodeMs = 0.0;
+        bool ready = false;
+    };
+    std::vector<DecodedFace> decoded(faces.size());
+    std::mutex mutex;
+    std::condition_variable faceReady;
+
+    for (unsigned int i = 0; i < faces.size() && !compiled; i++)
+    {
+        workerPool().submit([&, i] {
+            auto const decodeStart = std::chrono::steady_clock::now();
+            int width, height;
+            unsigned char *data = loadImage(faces[i], &width, &height, 3);
+            std::vector<unsigned char> chain;
+            if (data && width == side && height == side)
+            {
+                chain.resize(mipChainBytes(width, height));
+                std::copy(data, data + size_t(width) * height * 3, chain.begin());
+                generateMipChain(chain.data(), width, height, nullptr);
+            }
             stbi_image_free(data);
+            double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded[i].chain.swap(chain);
+            decoded[i].decodeMs = ms;
+            decoded[i].ready = true;
+            faceReady.notify_all();
+        });
+    }
+
+    double decodeTotalMs = 0.0;
+    size_t storedBytes = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+        GLenum const target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+        if (compiled)
+        {
+            for (int level = skippedLevels; level < levelCount; ++level)
+            {
+                const TextureContainerLevel &entry = containerLevels[i][level];
+                glCompressedTexSubImage2D(target, level - skippedLevels, 0, 0, entry.width, entry.height,
+                                          internalFormat, entry.size, containers[i].data() + entry.offset);
+                storedBytes += entry.size;
+            }
+            containers[i].close();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        faceReady.wait(lock, [&] { return decoded[i].ready; });
+        DecodedFace face;
+        std::swap(face, decoded[i]);
+        lock.unlock();
+
+        if (!face.chain.empty())
+        {
+            auto const uploadStart = std::chrono::steady_clock::now();
+            for (int level = skippedLevels; level < levelCount; ++level)
+            {
+                int const levelSide = std::max(1, side >> level);
+                glTexSubImage2D(target, level - skippedLevels, 0, 0, levelSide, levelSide, GL_RGB, GL_UNSIGNED_BYTE,
+                                face.chain.data() + mipLevelOffset(side, side, level));
+                storedBytes += size_t(levelSide) * levelSide * 4; // drivers keep RGB8 padded to 4 bytes
+            }
+            std::cout << "skybox face " << i << ": decode and mips " << face.decodeMs << " ms, upload "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count()
+                      << " ms (" << faces[i] << ")" << std::endl;
         }
         else
         {
             std::cerr << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
         }
+        decodeTotalMs += face.decodeMs;
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    std::cout << "skybox: " << faces.size() << " faces " << side << "x" << side << " stored at " << storedSide << "x"
+              << storedSide << " " << (compiled ? "BC1" : "RGB8") << ", " << levelCount - skippedLevels << " levels, "
+              << storedBytes / 1024 << " KB, "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms wall, " << decodeTotalMs << " ms of decoding on " << workerPool().size() << " threads"
+              << std::endl;
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -341,98 +5100,192 @@ unsigned int loadCubemap(std::vector<std::string> faces)
     return textureID;
 }
 
-unsigned int compileSkyboxShaderProgram()
+unsigned int compileSkyboxShaderProgram(ProgramCache &programs)
 {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    std::string vertexShaderStr = getSkyboxVertexShaderSource();
-    const char* vertexShaderSource = vertexShaderStr.c_str();
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // TODO: check compile errors
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    std::string fragmentShaderStr = getSkyboxFragmentShaderSource();
-    const char* fragmentShaderSource = fragmentShaderStr.c_str();
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glCompileShader(fragmentShader);
-    // TODO: check compile errors
-
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
-    glLinkProgram(program);
-    // TODO: check linking errors
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    return program;
+    return programs.build(getSkyboxVertexShaderSource(), getSkyboxFragmentShaderSource(), "skybox");
 }
 
-GLuint createSphereVAO(unsigned int rings, unsigned int sectors, unsigned int &indexCount)
+// a numeric command line value, rejected with a message unless all of text parses and lies in [minimum, maximum]
+bool parseFloatArgument(const std::string &name, const char *text, float minimum, float maximum, float &value)
 {
-    std::vector<vec3> vertices;
-    std::vector<vec3> colors;
-    std::vector<unsigned int> indices;
-
-    float const R = 1.0f / float(rings - 1);
-    float const S = 1.0f / float(sectors - 1);
+    char *end = nullptr;
+    errno = 0;
+    float const parsed = std::strtof(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE || !(parsed >= minimum && parsed <= maximum))
+    {
+        std::cerr << "Invalid value for " << name << ": " << text << ", expected a number from " << minimum << " to "
+                  << maximum << std::endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
 
-    for (unsigned int r = 0; r < rings; ++r)
+bool parseIntegerArgument(const std::string &name, const char *text, long minimum, long maximum, long &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    long const parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < minimum || parsed > maximum)
     {
-        for (unsigned int s = 0; s < sectors; ++s)
-        {
-            float const y = sin(-glm::half_pi<float>() + glm::pi<float>() * r * R);
-            float const x = cos(2 * glm::pi<float>() * s * S) * sin(glm::pi<float>() * r * R);
-            float const z = sin(2 * glm::pi<float>() * s * S) * sin(glm::pi<float>() * r * R);
-            vertices.push_back(vec3(x, y, z));
-            colors.push_back(vec3(1.0f, 0.0f, 1.0f)); // pink color!
-        }
+        std::cerr << "Invalid value for " << name << ": " << text << ", expected a whole number from " << minimum
+                  << " to " << maximum << std::endl;
+        return false;
     }
+    value = parsed;
+    return true;
+}
 
-    for (unsigned int r = 0; r < rings - 1; ++r)
+int main(int argc, char *argv[])
+{
+    // render options
+    GLenum sphereMode = GL_TRIANGLES;
+    bool quantizedVertices = false;
+    bool proceduralSpheres = false;
+    bool icosphereBodies = false;
+    bool sphereLOD = true;
+    float lodPixelError = 0.5f;
+    unsigned int sphereDetail = 96; // finest UV sphere level, raised for close-up captures
+    bool printFrameStats = false;
+    std::string meshCacheDirectory = "cache/meshes";
+    std::string programCacheDirectory = "cache/programs";
+    bool watchShaders = false;
+    size_t textureBudgetBytes = size_t(256) << 20;
+    bool textureArrayBodies = false;
+    int skyboxMaxSide = 0; // 0 keeps the faces at full resolution
+    std::string earthVirtualTexture; // source image, empty for the regular earth texture
+
+    // command line tools, these run without opening a window
+    for (int i = 1; i < argc; ++i)
     {
-        for (unsigned int s = 0; s < sectors - 1; ++s)
+        std::string arg = argv[i];
+        if (arg == "--bench-sphere")
         {
-            indices.push_back(r * sectors + s);
-            indices.push_back(r * sectors + (s + 1));
-            indices.push_back((r + 1) * sectors + (s + 1));
-
-            indices.push_back(r * sectors + s);
-            indices.push_back((r + 1) * sectors + (s + 1));
-            indices.push_back((r + 1) * sectors + s);
+            benchmarkSphereGeneration();
+            return 0;
+        }
+        if (arg == "--bench-sphere-threads")
+        {
+            benchmarkParallelSphereGeneration();
+            return 0;
+        }
+        if (arg == "--report-vcache")
+        {
+            reportSphereVertexCache();
+            return 0;
+        }
+        if (arg == "--bench-vertex-stage")
+        {
+            benchmarkVertexStage();
+            return 0;
+        }
+        if (arg == "--bench-indices")
+        {
+            benchmarkIndexEncodings();
+            return 0;
+        }
+        if (arg == "--report-icosphere")
+        {
+            reportIcosphere();
+            return 0;
+        }
+        if (arg == "--bench-image-decode")
+        {
+            benchmarkImageDecode();
+            return 0;
+        }
+        if (arg == "--compile-textures")
+        {
+            compileTextures();
+            return 0;
+        }
+        if (arg == "--verify-quantized")
+        {
+            return verifyQuantizedFormats() ? 0 : 1;
+        }
+        if (arg == "--strips")
+        {
+            sphereMode = GL_TRIANGLE_STRIP;
+        }
+        if (arg == "--quantized")
+        {
+            quantizedVertices = true;
+        }
+        if (arg == "--procedural")
+        {
+            proceduralSpheres = true;
+        }
+        if (arg == "--icosphere")
+        {
+            icosphereBodies = true;
+        }
+        if (arg == "--no-lod")
+        {
+            sphereLOD = false;
+        }
+        if (arg == "--lod-error" && i + 1 < argc && !parseFloatArgument(arg, argv[++i], 0.0f, 1000.0f, lodPixelError))
+        {
+            return 1;
+        }
+        if (arg == "--sphere-detail" && i + 1 < argc)
+        {
+            long detail;
+            if (!parseIntegerArgument(arg, argv[++i], 96, 8192, detail))
+            {
+                return 1;
+            }
+            sphereDetail = detail;
+        }
+        if (arg == "--stats")
+        {
+            printFrameStats = true;
+        }
+        if (arg == "--texture-budget" && i + 1 < argc)
+        {
+            long megabytes;
+            if (!parseIntegerArgument(arg, argv[++i], 1, 1 << 20, megabytes))
+            {
+                return 1;
+            }
+            textureBudgetBytes = size_t(megabytes) << 20;
+        }
+        if (arg == "--build-virtual-texture" && i + 1 < argc)
+        {
+            return buildVirtualTexture(argv[i + 1], workerPool()) ? 0 : 1;
+        }
+        if (arg == "--virtual-texture" && i + 1 < argc)
+        {
+            earthVirtualTexture = argv[++i];
+        }
+        if (arg == "--skybox-size" && i + 1 < argc)
+        {
+            long side;
+            if (!parseIntegerArgument(arg, argv[++i], 1, 16384, side))
+            {
+                return 1;
+            }
+            skyboxMaxSide = side;
+        }
+        if (arg == "--texture-array")
+        {
+            textureArrayBodies = true;
+        }
+        if (arg == "--watch-shaders")
+        {
+            watchShaders = true;
+        }
+        if (arg == "--no-program-cache")
+        {
+            programCacheDirectory.clear();
+        }
+        if (arg == "--no-mesh-cache")
+        {
+            meshCacheDirectory.clear();
         }
     }
 
-    GLuint vao, vbo[2], ebo;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    glGenBuffers(2, vbo);
-
-    // position buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0); // aPos
-    glEnableVertexAttribArray(0);
-
-    // color buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(vec3), &colors[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *)0); // aColor
-    glEnableVertexAttribArray(1);
+    StartupTimer startupTimer;
 
-    // indices
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    indexCount = indices.size();
-    return vao;
-}
-
-int main(int argc, char *argv[])
-{
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -462,17 +5315,35 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    // hidden window whose context shares objects with the main one, the shader watcher compiles on it
+    GLFWwindow *reloadContext = nullptr;
+    if (watchShaders)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        reloadContext = glfwCreateWindow(1, 1, "shader reload", NULL, window);
+        if (!reloadContext)
+        {
+            std::cerr << "Failed to create the shader reload context, shaders are not watched" << std::endl;
+        }
+    }
+
+    startupTimer.mark("window and GL init");
+
     // compile base shaders
-    int shaderProgram = compileVertexAndFragShaders();
+    // programs come from driver binaries under cache/programs when a previous run left them there
+    ProgramCache programCache(programCacheDirectory);
+    ShaderProgram shaderProgram(compileVertexAndFragShaders(programCache));
 
-    glUseProgram(shaderProgram);
+    shaderProgram.use();
 
     // compile skybox shader
-    unsigned int skyboxShaderProgram = compileSkyboxShaderProgram();
-    glUseProgram(skyboxShaderProgram);
-    glUniform1i(glGetUniformLocation(skyboxShaderProgram, "skybox"), 0); 
+    ShaderProgram skyboxShaderProgram(compileSkyboxShaderProgram(programCache));
+    skyboxShaderProgram.use();
+    skyboxShaderProgram.set(uniformSkybox, 0);
 	// set sampler to texture unit 0
 
+    startupTimer.mark("base and skybox shaders", programCache.summary());
+
     // load skybox cubemap textures
     std::vector<std::string> faces = {
 		"textures/skybox1/1.png",
@@ -482,7 +5353,8 @@ int main(int argc, char *argv[])
         "textures/skybox1/5.png",
         "textures/skybox1/6.png"
 	};
-    unsigned int cubemapTexture = loadCubemap(faces);
+    unsigned int cubemapTexture = loadCubemap(faces, skyboxMaxSide);
+    startupTimer.mark("skybox cubemap");
 
     // camera parameters for view transform
     vec3 cameraPosition(0.6f, 1.0f, 10.0f);
@@ -513,8 +5385,13 @@ int main(int argc, char *argv[])
         100.0f
 	);
 
-    GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+    // camera for the programs that declare FrameData, rewritten once per frame
+    GLuint frameDataBuffer;
+    glGenBuffers(1, &frameDataBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, frameDataBinding, frameDataBuffer);
 
     // Set initial view matrix
     mat4 viewMatrix = lookAt(
@@ -523,26 +5400,111 @@ int main(int argc, char *argv[])
 		cameraUp
 		);
 
-    GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
 
 
     // define and upload geometry to the GPU
-    int vao = createVertexBufferObject();
+    int vao = createVertexBufferObject(quantizedVertices);
+
+    // bodies with the same tessellation share one uploaded mesh
+    MeshRegistry meshRegistry(meshCacheDirectory);
+
+    // body textures decode on the worker pool while the meshes below are built, each shows a grey placeholder until
+    // its upload has been pumped
+    // with --texture-array, same-sized body textures are layers of one array texture bound once per frame, and only
+    // bodies left without a layer get a 2D texture of their own
+    TextureManager textureManager(workerPool(), textureBudgetBytes);
+    std::vector<int> bodyLayers(3, -1); // sun, earth, moon
+    GLuint bodyTextureArray = 0;
+    if (textureArrayBodies)
+    {
+        bodyTextureArray = loadTextureArray({"textures/sun.jpg", "textures/earth.jpg", "textures/moon.jpg"}, bodyLayers);
+    }
+    // the skybox and array decodes are done, the loader trims again after its own
+    imagePoolTrim();
+    TextureHandle moonTexture = bodyLayers[2] < 0 ? textureManager.acquire("textures/moon.jpg") : TextureHandle();
+
+    // a virtual texture replaces the earth texture, its pages stream in as the feedback pass asks for them
+    VirtualTexture earthVirtual;
+    if (!earthVirtualTexture.empty() && earthVirtual.open(earthVirtualTexture, 16))
+    {
+        bodyLayers[1] = -1;
+    }
+    TextureHandle earthTexture =
+        bodyLayers[1] < 0 && !earthVirtual.isOpen() ? textureManager.acquire("textures/earth.jpg") : TextureHandle();
+
+    std::string const sphereFragmentSource = getTexturedSphereFragmentShaderSource();
+    std::string const sphereArrayFragmentSource = getTexturedSphereArrayFragmentShaderSource();
+    ShaderProgram orbShader(
+        compileTexturedSphereShader(programCache, getTexturedSphereVertexShaderSource(), sphereFragmentSource));
+    ShaderProgram orbArrayShader(
+        compileTexturedSphereShader(programCache, getTexturedSphereVertexShaderSource(), sphereArrayFragmentSource));
+
+    // bufferless alternative, toggled with P
+    ShaderProgram proceduralSphereShader(
+        compileTexturedSphereShader(programCache, getProceduralSphereVertexShaderSource(), sphereFragmentSource));
+    ShaderProgram proceduralArraySphereShader(
+        compileTexturedSphereShader(programCache, getProceduralSphereVertexShaderSource(), sphereArrayFragmentSource));
+    GLuint proceduralVAO;
+    glGenVertexArrays(1, &proceduralVAO);
+
+    std::string const virtualFragmentSource = getTexturedSphereVirtualFragmentShaderSource();
+    std::string const feedbackFragmentSource = getVirtualTextureFeedbackFragmentShaderSource();
+    ShaderProgram virtualShaders[2] = {
+        ShaderProgram(compileTexturedSphereShader(programCache, getTexturedSphereVertexShaderSource(), virtualFragmentSource)),
+        ShaderProgram(compileTexturedSphereShader(programCache, getProceduralSphereVertexShaderSource(), virtualFragmentSource))};
+    ShaderProgram feedbackShaders[2] = {
+        ShaderProgram(compileTexturedSphereShader(programCache, getTexturedSphereVertexShaderSource(), feedbackFragmentSource)),
+        ShaderProgram(compileTexturedSphereShader(programCache, getProceduralSphereVertexShaderSource(), feedbackFragmentSource))};
+
+    // the body programs sample unit 0, programs keep their uniforms so this is set once
+    for (const ShaderProgram *program : {&orbShader, &orbArrayShader, &proceduralSphereShader, &proceduralArraySphereShader})
+    {
+        program->use();
+        program->set(uniformTexture1, 0);
+    }
 
-    unsigned int moonIndexCount = 0;
-    GLuint moonVAO = createTexturedSphereVAO(40, 40, moonIndexCount);
-    GLuint moonTexture = loadTexture("textures/moon.jpg");
+    std::unique_ptr<ShaderWatcher> shaderWatcher;
+    if (reloadContext)
+    {
+        shaderWatcher.reset(new ShaderWatcher(reloadContext, "shaders"));
+        shaderWatcher->watch(shaderProgram, "shaders/shader.vert.glsl", "shaders/shader.frag.glsl", "base");
+        shaderWatcher->watch(skyboxShaderProgram, "shaders/skybox_vertex.glsl", "shaders/skybox_fragment.glsl", "skybox");
+        std::string const vertexPaths[2] = {"shaders/textured_sphere.vert.glsl", "shaders/textured_sphere_procedural.vert.glsl"};
+        ShaderProgram *const sphereShaders[2] = {&orbShader, &proceduralSphereShader};
+        ShaderProgram *const sphereArrayShaders[2] = {&orbArrayShader, &proceduralArraySphereShader};
+        for (int procedural = 0; procedural < 2; ++procedural)
+        {
+            std::string const label = procedural ? "procedural sphere" : "sphere";
+            shaderWatcher->watch(*sphereShaders[procedural], vertexPaths[procedural], "shaders/textured_sphere.frag.glsl", label);
+            shaderWatcher->watch(*sphereArrayShaders[procedural], vertexPaths[procedural],
+                                 "shaders/textured_sphere_array.frag.glsl", label + " array");
+            shaderWatcher->watch(virtualShaders[procedural], vertexPaths[procedural],
+                                 "shaders/textured_sphere_virtual.frag.glsl", label + " virtual");
+            shaderWatcher->watch(feedbackShaders[procedural], vertexPaths[procedural],
+                                 "shaders/virtual_texture_feedback.frag.glsl", label + " feedback");
+        }
+        shaderWatcher->start();
+    }
 
-    unsigned int earthIndexCount = 0;
-    GLuint earthVAO = createTexturedSphereVAO(40, 40, earthIndexCount);
-    GLuint earthTexture = loadTexture("textures/earth.jpg");
+    TextureHandle sunTexture = bodyLayers[0] < 0 ? textureManager.acquire("textures/sun.jpg") : TextureHandle();
+    startupTimer.mark("body shaders and texture requests", "all programs: " + programCache.summary());
 
-    GLuint orbShader = compileTexturedSphereShader();
+    // every body picks its level from these chains each frame by projected size
+    // without LOD the chains hold only the 40x40 UV sphere and the icosphere matching it (toggled with I)
+    unsigned int const icosphereLevel = icosphereLevelForUVSphere(40, 40);
+    LODChain uvSphereLODs = createUVSphereLODChain(
+        meshRegistry, sphereLOD ? std::vector<unsigned int>{sphereDetail, 64, 40, 24, 16, 10, 6} : std::vector<unsigned int>{40},
+        sphereMode, quantizedVertices);
+    LODChain icosphereLODs = createIcosphereLODChain(
+        meshRegistry, sphereLOD ? std::vector<unsigned int>{5, 4, 3, 2, 1} : std::vector<unsigned int>{icosphereLevel},
+        quantizedVertices);
 
-    GLuint sunTexture = loadTexture("textures/sun.jpg");
-    unsigned int sunIndexCount = 0;
-    GLuint sunVAO = createTexturedSphereVAO(40, 40, sunIndexCount);
+    meshRegistry.printStats();
+    textureManager.printStats();
+    startupTimer.mark("meshes", meshCacheDirectory.empty() ? "cache off"
+                                                           : std::to_string(meshRegistry.cacheHitCount()) + " cached, " +
+                                                                 std::to_string(meshRegistry.cacheMissCount()) + " generated");
+    startupTimer.print();
 
 
     // for frame time
@@ -553,6 +5515,16 @@ int main(int argc, char *argv[])
     // pause state
     bool isPaused = false;
     bool wasSpacePressed = false;
+    bool wasProceduralKeyPressed = false;
+    bool wasIcosphereKeyPressed = false;
+
+    // frame time report, vsync off so the numbers mean something
+    FrameStats frameStats;
+    frameStats.intervalStart = glfwGetTime();
+    if (printFrameStats)
+    {
+        glfwSwapInterval(0);
+    }
 
     // enable Backface culling
     glEnable(GL_CULL_FACE);
@@ -560,6 +5532,9 @@ int main(int argc, char *argv[])
     // enable depth testing
     glEnable(GL_DEPTH_TEST);
 
+    // filter across cube face edges instead of clamping within each face
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
 
     float skyboxVertices[] = {-1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f,
                               1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f, 1.0f,  -1.0f,
@@ -592,6 +5567,18 @@ int main(int argc, char *argv[])
     // main loop
     while (!glfwWindowShouldClose(window))
     {
+        // shaders edited on disk take effect from this frame on
+        if (shaderWatcher && shaderWatcher->applyReloads() > 0)
+        {
+            for (ShaderProgram *program : {&orbShader, &orbArrayShader, &proceduralSphereShader, &proceduralArraySphereShader})
+            {
+                program->use();
+                program->set(uniformTexture1, 0);
+            }
+            skyboxShaderProgram.use();
+            skyboxShaderProgram.set(uniformSkybox, 0);
+        }
+
         // frame time calculation
         float dt = glfwGetTime() - lastFrameTime;
         lastFrameTime += dt;
@@ -623,8 +5610,14 @@ int main(int argc, char *argv[])
             glm::vec3 position = cameraPosition - radius * cameraLookAt;
             viewMatrix = lookAt(position, position + cameraLookAt, cameraUp);
         }
-        GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+
+        // Define fixed sun position as the center of orbit, it is also the light
+        vec3 sunPosition = vec3(0.0f, 0.0f, -20.0f);  // Moved back further and centered
+
+        mat4 const viewProjection = multiplyMatrix(projectionMatrix, viewMatrix);
+        FrameData frameData;
+        frameData.skyboxViewProjection = multiplyMatrix(projectionMatrix, mat4(mat3(viewMatrix))); // remove translation for skybox
+        writeFrameData(frameDataBuffer, frameData);
 
         // === RENDER SKYBOX FIRST ===
 
@@ -632,30 +5625,7 @@ int main(int argc, char *argv[])
         glDepthFunc(GL_LEQUAL);
 
         // Use your skybox shader
-        glUseProgram(skyboxShaderProgram);
-
-        // remove translation for skybox
-        mat4 skyboxView = mat4(mat3(viewMatrix));
-
-        glUniformMatrix4fv(
-			glGetUniformLocation(
-			skyboxShaderProgram, 
-			"view"
-		), 
-			1, 
-			GL_FALSE, 
-			&skyboxView[0][0]
-		);
-
-        glUniformMatrix4fv(
-			glGetUniformLocation(
-			skyboxShaderProgram, 
-			"projection"
-		), 
-			1, 
-			GL_FALSE,
-			&projectionMatrix[0][0]
-		);
+        skyboxShaderProgram.use();
 
         glBindVertexArray(skyboxVAO);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
@@ -663,15 +5633,12 @@ int main(int argc, char *argv[])
         glDepthFunc(GL_LESS); // restore default depth function
 
         // === REST OF SCENE ===
-        glUseProgram(shaderProgram);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+        shaderProgram.use();
 
         // draw geometry
         glBindVertexArray(vao);
 
         // draw ground
-        GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
 
         spinningCubeAngle += 180.0f * dt;
 
@@ -692,8 +5659,7 @@ int main(int argc, char *argv[])
 					vec3(0.1f, 0.1f, 0.1f)
 					);
 
-            glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &spinningCubeWorldMatrix[0][0]);
-            glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+            shaderProgram.set(uniformModelViewProjection, multiplyMatrix(viewProjection, spinningCubeWorldMatrix));
 
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
@@ -702,8 +5668,6 @@ int main(int argc, char *argv[])
         // update orb angle for animation
         orbAngle += 20.0f * animationDt; // slow circular movement
 
-        // Define fixed sun position as the center of orbit
-        vec3 sunPosition = vec3(0.0f, 0.0f, -20.0f);  // Moved back further and centered
         float earthOrbitRadius = 5.0f;  // Larger orbit radius for Earth around the Sun
         
         // compute Earth position (orbiting around the Sun)
@@ -724,6 +5688,24 @@ int main(int argc, char *argv[])
                 vec3(0.3f)  // Make Earth a bit larger
             );
 
+        // moon orbiting around the Earth
+        // compute moon position relative to the Earth
+        // Moon's orbit speed is relative to Earth's orbit, so we use the same time scale
+        float moonOrbitAngle = orbAngle * 4.0f; // moon orbits faster
+        float moonOrbitRadius = 1.0f;  // increased radius for visibility
+
+        // Earth's current position is orbX, orbY, orbZ
+        float moonX = orbX + moonOrbitRadius * cos(radians(moonOrbitAngle));
+        float moonZ = orbZ + moonOrbitRadius * sin(radians(moonOrbitAngle));
+        float moonY = orbY; // Keep the moon at the same height as Earth
+
+        mat4 moonWorldMatrix = translate(
+			mat4(1.0f), vec3(moonX, moonY, moonZ)
+		) * scale(
+			mat4(1.0f), 
+			vec3(0.08f, 0.08f, 0.08f)
+		); // smaller than earth
+
         // === RENDER SUN ===
         // Update sun rotation
         static float sunRotationAngle = 0.0f;
@@ -738,78 +5720,121 @@ int main(int argc, char *argv[])
             vec3(0.0f, 1.0f, 0.0f)  // Rotate around Y axis
         ) * scale(mat4(1.0f), vec3(2.0f));  // Made sun bigger
 
-        vec3 lightPos = sunPosition; // same as sun position
+        // every body's MVP in one batch, the vertex shaders only apply it
+        mat4 const bodyWorldMatrices[3] = {sunWorldMatrix, orbWorldMatrix, moonWorldMatrix};
+        mat4 bodyMVPs[3];
+        multiplyMatrices(viewProjection, bodyWorldMatrices, bodyMVPs, 3);
 
-        glUseProgram(orbShader);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, sunTexture);
-        glUniform1i(glGetUniformLocation(orbShader, "texture1"), 0);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "worldMatrix"), 1, GL_FALSE, &sunWorldMatrix[0][0]);
-        glUniform3fv(glGetUniformLocation(orbShader, "lightColor"), 1, &vec3(1.0f, 1.0f, 1.0f)[0]);
-        glUniform3fv(glGetUniformLocation(orbShader, "lightPos"), 1, &lightPos[0]);
-        glUniform3fv(glGetUniformLocation(orbShader, "viewPos"), 1, &cameraPosition[0]);
+        // buffered or bufferless spheres, sampling a 2D texture or a layer of the body array; all take the same uniforms
+        const ShaderProgram &sphereShader = proceduralSpheres ? proceduralSphereShader : orbShader;
+        const ShaderProgram &sphereArrayShader = proceduralSpheres ? proceduralArraySphereShader : orbArrayShader;
+        if (bodyTextureArray)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, bodyTextureArray);
+            frameStats.textureBinds++;
+        }
+        const LODChain &bodyLODs = icosphereBodies && !proceduralSpheres ? icosphereLODs : uvSphereLODs;
 
-        glBindVertexArray(sunVAO);
-        glDrawElements(GL_TRIANGLES, sunIndexCount, GL_UNSIGNED_INT, 0);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        float const viewportHeight = float(framebufferHeight);
 
+        const ShaderProgram *bodyShader = &bindBodyTexture(textureManager, sunTexture, bodyLayers[0], sphereShader,
+                                                           sphereArrayShader, frameStats.textureBinds);
+        bodyShader->set(uniformModelViewProjection, bodyMVPs[0]);
 
-        // === RENDER EARTH (or moon) ===
-        glUseProgram(orbShader);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, earthTexture);
-        glUniform1i(glGetUniformLocation(orbShader, "texture1"), 0);
+        frameStats.triangles += drawBodySphere(bodyLODs, projectedSphereRadius(sunWorldMatrix, viewMatrix, projectionMatrix, viewportHeight),
+                                               lodPixelError, proceduralSpheres, *bodyShader, proceduralVAO);
+        frameStats.baselineTriangles += 39 * 39 * 2;
 
-        // set matrices
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "worldMatrix"), 1, GL_FALSE, &orbWorldMatrix[0][0]);
 
-        glUniform3fv(glGetUniformLocation(orbShader, "lightColor"), 1, &vec3(1.0f)[0]);
-        glUniform3fv(glGetUniformLocation(orbShader, "lightPos"), 1, &lightPos[0]);
-        glUniform3fv(glGetUniformLocation(orbShader, "viewPos"), 1, &cameraPosition[0]);
+        // === RENDER EARTH (or moon) ===
+        if (earthVirtual.isOpen())
+        {
+            bodyShader = &virtualShaders[proceduralSpheres];
+            bodyShader->use();
+            earthVirtual.bind(*bodyShader);
+        }
+        else
+        {
+            bodyShader = &bindBodyTexture(textureManager, earthTexture, bodyLayers[1], sphereShader, sphereArrayShader,
+                                          frameStats.textureBinds);
+        }
+
+        bodyShader->set(uniformModelViewProjection, bodyMVPs[1]);
 
 
-        glBindVertexArray(earthVAO);
-        glDrawElements(GL_TRIANGLES, earthIndexCount, GL_UNSIGNED_INT, 0);
+        frameStats.triangles += drawBodySphere(bodyLODs, projectedSphereRadius(orbWorldMatrix, viewMatrix, projectionMatrix, viewportHeight),
+                                               lodPixelError, proceduralSpheres, *bodyShader, proceduralVAO);
+        frameStats.baselineTriangles += 39 * 39 * 2;
 
         // === Render the Moon orbiting around the Earth ===
+        bodyShader = &bindBodyTexture(textureManager, moonTexture, bodyLayers[2], sphereShader, sphereArrayShader,
+                                      frameStats.textureBinds);
+        bodyShader->set(uniformModelViewProjection, bodyMVPs[2]);
 
-        // compute moon position relative to the Earth
-        // Moon's orbit speed is relative to Earth's orbit, so we use the same time scale
-        float moonOrbitAngle = orbAngle * 4.0f; // moon orbits faster
-        float moonOrbitRadius = 1.0f;  // increased radius for visibility
+        frameStats.triangles += drawBodySphere(bodyLODs, projectedSphereRadius(moonWorldMatrix, viewMatrix, projectionMatrix, viewportHeight),
+                                               lodPixelError, proceduralSpheres, *bodyShader, proceduralVAO);
+        frameStats.baselineTriangles += 39 * 39 * 2;
 
-        // Earth's current position is orbX, orbY, orbZ
-        float moonX = orbX + moonOrbitRadius * cos(radians(moonOrbitAngle));
-        float moonZ = orbZ + moonOrbitRadius * sin(radians(moonOrbitAngle));
-        float moonY = orbY; // Keep the moon at the same height as Earth
 
-        mat4 moonWorldMatrix = translate(
-			mat4(1.0f), vec3(moonX, moonY, moonZ)
-		) * scale(
-			mat4(1.0f), 
-			vec3(0.08f, 0.08f, 0.08f)
-		); // smaller than earth
+        // the earth again at low resolution, recording which virtual texture tiles it needs
+        if (earthVirtual.isOpen())
+        {
+            const ShaderProgram &feedbackShader = feedbackShaders[proceduralSpheres];
+            earthVirtual.beginFeedback(framebufferWidth, framebufferHeight, feedbackShader);
+            feedbackShader.set(uniformModelViewProjection, bodyMVPs[1]);
+            drawBodySphere(bodyLODs, projectedSphereRadius(orbWorldMatrix, viewMatrix, projectionMatrix, viewportHeight),
+                           lodPixelError, proceduralSpheres, feedbackShader, proceduralVAO);
+            earthVirtual.endFeedback();
+        }
 
-        glUseProgram(orbShader);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, moonTexture);
-        glUniform1i(glGetUniformLocation(orbShader, "texture1"), 0);
+        // end Frame
+        glfwSwapBuffers(window);
+        glfwPollEvents();
 
-        // set matrices
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(orbShader, "worldMatrix"), 1, GL_FALSE, &moonWorldMatrix[0][0]);
+        if (earthVirtual.isOpen())
+        {
+            earthVirtual.update();
+        }
 
-        glBindVertexArray(moonVAO);
-        glDrawElements(GL_TRIANGLES, moonIndexCount, GL_UNSIGNED_INT, 0);
+        // finished texture decodes, a couple of milliseconds per frame at most, then the memory budget
+        textureManager.endFrame(2.0);
 
+        if (printFrameStats)
+        {
+            std::string label = proceduralSpheres ? "procedural uvsphere" : icosphereBodies ? "icosphere" : "uvsphere";
+            frameStats.endFrame(glfwGetTime(), label + (sphereLOD ? " lod" : " fixed"));
+        }
 
-        // end Frame
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // I swaps the bodies between the UV sphere and the matching icosphere
+        if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
+        {
+            if (!wasIcosphereKeyPressed)
+            {
+                icosphereBodies = !icosphereBodies;
+                wasIcosphereKeyPressed = true;
+            }
+        }
+        else
+        {
+            wasIcosphereKeyPressed = false;
+        }
+
+        // P toggles bufferless sphere rendering
+        if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+        {
+            if (!wasProceduralKeyPressed)
+            {
+                proceduralSpheres = !proceduralSpheres;
+                wasProceduralKeyPressed = true;
+            }
+        }
+        else
+        {
+            wasProceduralKeyPressed = false;
+        }
 
         // handle inputs
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -913,6 +5938,25 @@ int main(int argc, char *argv[])
         }
     }
 
+    // release GL objects while the context is still alive
+    shaderWatcher.reset();
+    if (reloadContext)
+    {
+        glfwDestroyWindow(reloadContext);
+    }
+    textureManager.release();
+    uvSphereLODs.levels.clear();
+    icosphereLODs.levels.clear();
+    sunTexture.reset();
+    earthTexture.reset();
+    moonTexture.reset();
+    glDeleteTextures(1, &bodyTextureArray);
+    if (earthVirtual.isOpen())
+    {
+        earthVirtual.printStats();
+    }
+    earthVirtual.release();
+
     // shutdown GLFW
     glfwTerminate();
 
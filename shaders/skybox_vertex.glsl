@@ -3,12 +3,15 @@ layout(location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// per-frame camera, bound for every program that declares it (FrameData in main.cpp)
+layout (std140) uniform FrameData
+{
+    mat4 skyboxViewProjection; // view without its translation
+};
 
 void main()
 {
     TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    vec4 pos = skyboxViewProjection * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
 }
@@ -0,0 +1,8 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2DArray texture1;
+uniform int layer;
+void main() {
+    FragColor = texture(texture1, vec3(TexCoord, layer));
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// bufferless UV sphere: position and uv are rebuilt from gl_VertexID
+// vertex order matches generateSphere's triangle list, draw (rings - 1) * (sectors - 1) * 6 vertices
+uniform int rings;
+uniform int sectors;
+uniform mat4 modelViewProjection;
+out vec2 TexCoord;
+
+const float PI = 3.14159265358979;
+
+// (ring, sector) offset of each quad corner, two triangles per quad
+const ivec2 quadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 1), ivec2(0, 0), ivec2(1, 1), ivec2(1, 0));
+
+void main() {
+    int quad = gl_VertexID / 6;
+    ivec2 corner = quadCorners[gl_VertexID % 6];
+    int r = quad / (sectors - 1) + corner.x;
+    int s = quad % (sectors - 1) + corner.y;
+
+    vec2 uv = vec2(float(s) / float(sectors - 1), float(r) / float(rings - 1));
+    float ringAngle = PI * uv.y;
+    float sectorAngle = 2.0 * PI * uv.x;
+    vec3 position = vec3(cos(sectorAngle) * sin(ringAngle), -cos(ringAngle), sin(sectorAngle) * sin(ringAngle));
+
+    TexCoord = uv;
+    gl_Position = modelViewProjection * vec4(position, 1.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2D indirection; // one texel per tile and level: page x, page y, level actually mapped
+uniform sampler2D pages;       // page cache, tiles with a border on every side
+uniform vec2 virtualSize;
+uniform int levelCount;
+uniform float tileSize;
+uniform float pageBorder;
+uniform float pageCacheTexels;
+
+float virtualLevel(vec2 uv)
+{
+    vec2 texel = uv * virtualSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    return clamp(floor(lod + 0.5), 0.0, float(levelCount - 1));
+}
+
+void main() {
+    int level = int(virtualLevel(TexCoord));
+    ivec2 tiles = textureSize(indirection, level);
+    ivec2 tile = clamp(ivec2(TexCoord * vec2(tiles)), ivec2(0), tiles - 1);
+    vec4 entry = texelFetch(indirection, tile, level);
+
+    // the entry may point at an ancestor, position within that coarser tile
+    int mapped = int(entry.z * 255.0 + 0.5);
+    vec2 position = TexCoord * virtualSize / exp2(float(mapped)) / tileSize;
+    vec2 mappedTile = clamp(floor(position), vec2(0.0), vec2(textureSize(indirection, mapped) - 1));
+    vec2 page = floor(entry.xy * 255.0 + 0.5);
+    vec2 physical = page * (tileSize + 2.0 * pageBorder) + pageBorder + (position - mappedTile) * tileSize;
+    FragColor = texture(pages, physical / pageCacheTexels);
+}
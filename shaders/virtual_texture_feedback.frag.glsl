@@ -0,0 +1,25 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2D indirection;
+uniform vec2 virtualSize;
+uniform int levelCount;
+uniform float lodBias; // the feedback target is smaller than the screen
+
+float virtualLevel(vec2 uv)
+{
+    vec2 texel = uv * virtualSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + lodBias;
+    return clamp(floor(lod + 0.5), 0.0, float(levelCount - 1));
+}
+
+// names the tile this pixel needs: low bits of x and y, then level with the high bits of x and y
+void main() {
+    int level = int(virtualLevel(TexCoord));
+    ivec2 tiles = textureSize(indirection, level);
+    ivec2 tile = clamp(ivec2(TexCoord * vec2(tiles)), ivec2(0), tiles - 1);
+    int packed = level | ((tile.x >> 8) << 4) | ((tile.y >> 8) << 6);
+    FragColor = vec4(float(tile.x & 255), float(tile.y & 255), float(packed), 255.0) / 255.0;
+}